@@ -6,6 +6,12 @@ if(CMAKE_BUILD_TYPE STREQUAL "")
 endif()
 # (you can also set it on the command line: -D CMAKE_BUILD_TYPE=Release)
 
+# compile-time instrumentation, must be the same for everything linked together
+option(PCX_MESSAGE_BUS_METRICS "Keep per message type dispatch metrics in pcx::MessageBus" OFF)
+if (PCX_MESSAGE_BUS_METRICS)
+   add_definitions(-DPCX_MESSAGE_BUS_METRICS=1)
+endif ()
+
 #
 # standard compiler and linker settings
 #
@@ -20,7 +26,7 @@ if (MSVC)
    endif ()
 else ()
    set(CMAKE_CXX_FLAGS                "-Wall -std=c++11")
-   set(CMAKE_CXX_FLAGS_RELEASE        "-DNDEBUG -04")
+   set(CMAKE_CXX_FLAGS_RELEASE        "-DNDEBUG -O3")
    set(CMAKE_CXX_FLAGS_DEBUG          "-O0 -g")
    set(CMAKE_CXX_FLAGS_MINSIZEREL     "-Os -DNDEBUG")
    set(CMAKE_CXX_FLAGS_RELWITHDEBINFO "-O2 -g")
@@ -0,0 +1,104 @@
+#ifndef PCX_CONCURRENT_INDEX_POOL_H
+#define PCX_CONCURRENT_INDEX_POOL_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// ConcurrentIndexPool checks for double frees, and answers IsAllocated, only when
+// this is non-zero, as it costs a write to a flag per index on every call and
+// neighbouring flags share cache lines between threads. Defaults to on in debug
+// builds. It only changes ConcurrentIndexPool.cpp, which decides for the program.
+#ifndef PCX_CONCURRENT_INDEX_POOL_CHECKS
+#ifdef NDEBUG
+#define PCX_CONCURRENT_INDEX_POOL_CHECKS 0
+#else
+#define PCX_CONCURRENT_INDEX_POOL_CHECKS 1
+#endif
+#endif
+
+namespace pcx
+{
+   /**
+    * @brief The ConcurrentIndexPool class hands out indices like a fixed IndexPool
+    * but may be allocated from and freed to by many threads at once, without locks.
+    * Free indices are kept on a lock-free stack whose head is tagged against ABA,
+    * and each thread also works from a magazine of cached free indices, so that
+    * most calls touch only the thread's own magazine and never the shared stack.
+    * Magazines are taken in batches from the stack and returned to it in batches
+    * once full. There are a fixed number of magazines, shared out between threads;
+    * a thread that finds its magazine in use by another goes to the stack instead.
+    * Allocation order is unspecified, and there is no iteration: the indices a
+    * thread sees allocated may be stale by the time it looks.
+    * Threads still share cache lines when they go to the stack, through its head
+    * and the links of the indices on it, when they take indices from another
+    * thread's magazine, and, with PCX_CONCURRENT_INDEX_POOL_CHECKS on, through the
+    * allocated flags written by every call.
+    */
+   class ConcurrentIndexPool
+   {
+   public:
+      /// magazines defaults to twice the number of hardware threads
+      explicit ConcurrentIndexPool(long size, unsigned magazines = 0);
+
+      /**
+       * Throws if no free index can be found. Close to capacity that can happen
+       * while other threads are still part way through freeing indices
+       */
+      long Allocate();
+      /// Throws if index is out of range, or with checks on if it is not allocated
+      void Free(long index);
+
+      /// Throws unless PCX_CONCURRENT_INDEX_POOL_CHECKS is on
+      bool IsAllocated(long index) const;
+
+      long Reserved() const { return size_; }
+
+      /// Exact only while no other thread is allocating or freeing
+      long Size() const;
+
+   private:
+      ConcurrentIndexPool(ConcurrentIndexPool const &);
+      ConcurrentIndexPool & operator=(ConcurrentIndexPool const &);
+
+      static const std::uint32_t npos = ~std::uint32_t(0);
+      static const std::uint32_t MagazineSize = 32;
+
+      struct Magazine
+      {
+         Magazine() : locked(false), count(0), net(0) { }
+
+         std::atomic<bool> locked;
+         std::uint32_t count;
+         std::atomic<long> net;     // allocations less frees made through this magazine
+         std::uint32_t indices[MagazineSize];
+
+         // keep each magazine on its own cache lines so threads never share one
+         char padding[64];
+      };
+
+      // the calling thread's magazine, locked, or nullptr if another thread has it
+      Magazine * LocalMagazine();
+      static bool TryLock(Magazine & magazine);
+      static std::uint32_t Take(Magazine & magazine);
+
+      // the shared stack, where head_ holds a tag above the index of its top entry
+      std::uint32_t Pop();
+      std::uint32_t PopChain(std::uint32_t * out, std::uint32_t max);
+      void PushChain(std::uint32_t const * indices, std::uint32_t count);
+
+      long size_;
+      std::unique_ptr<std::atomic<std::uint32_t>[]> next_;
+      std::unique_ptr<std::atomic<bool>[]> allocated_;  // only with PCX_CONCURRENT_INDEX_POOL_CHECKS
+      std::vector<std::unique_ptr<Magazine>> magazines_;
+
+      char padding_[64];
+      std::atomic<std::uint64_t> head_;
+      char headPadding_[64];
+      std::atomic<long> sharedNet_;    // allocations less frees made straight from the stack
+   };
+
+} // namespace pcx
+
+#endif // #ifndef PCX_CONCURRENT_INDEX_POOL_H
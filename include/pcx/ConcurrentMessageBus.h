@@ -0,0 +1,156 @@
+#ifndef PCX_CONCURRENT_MESSAGE_BUS_H
+#define PCX_CONCURRENT_MESSAGE_BUS_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include <pcx/impl/EpochDomain.h>
+#include <pcx/impl/MessageTypeSlot.h>
+
+namespace pcx
+{
+   /**
+    * @brief The ConcurrentMessageBus class is a MessageBus that may be published to
+    * from many threads at once.
+    * Publishing takes no locks: the dispatch tables are immutable snapshots which
+    * subscribe/unsubscribe replace copy-on-write, and replaced snapshots are reclaimed
+    * once no publisher can still be walking them (see impl::EpochDomain).
+    * Subscribe and unsubscribe are serialised against each other but never block
+    * publishers. Callbacks may be invoked concurrently and must be thread safe; a
+    * callback may still be invoked by a publish already in flight when it is
+    * unsubscribed.
+    */
+   class ConcurrentMessageBus {
+   public:
+      typedef std::uint64_t SubscriptionId;
+
+      ConcurrentMessageBus() : table_(new PublisherTable{}), nextSubscriptionId_(1) { }
+
+      ~ConcurrentMessageBus() {
+         delete table_.load();
+      }
+
+      template <typename Message>
+      SubscriptionId subscribe(std::function<void(void*,Message const &)> callback) {
+         std::lock_guard<std::mutex> lock(writeMutex_);
+
+         auto & publisher = findOrCreatePublisher<Message>();
+         auto id = nextSubscriptionId_++;
+
+         auto * current = publisher.subscribers.load();
+         auto * updated = new SubscriberList<Message>(*current);
+         updated->entries.push_back(std::make_pair(id, std::move(callback)));
+         replace(publisher.subscribers, current, updated);
+
+         return id;
+      }
+
+      template <typename Message>
+      bool unsubscribe(SubscriptionId id) {
+         std::lock_guard<std::mutex> lock(writeMutex_);
+
+         auto * publisher = findPublisher<Message>(*table_.load());
+         if (!publisher) return false;
+
+         auto * current = publisher->subscribers.load();
+         auto & entries = current->entries;
+         auto it = std::find_if(entries.begin(), entries.end(),
+            [=](typename SubscriberList<Message>::Entry const & entry) { return entry.first == id; });
+         if (it == entries.end()) return false;
+
+         auto * updated = new SubscriberList<Message>{};
+         updated->entries.reserve(entries.size() - 1);
+         updated->entries.insert(updated->entries.end(), entries.begin(), it);
+         updated->entries.insert(updated->entries.end(), it + 1, entries.end());
+         replace(publisher->subscribers, current, updated);
+
+         return true;
+      }
+
+      template <typename Message>
+      void publish(void* sender, Message const & message) {
+         impl::EpochGuard guard;
+
+         auto * publisher = findPublisher<Message>(*table_.load());
+         if (!publisher) return;
+
+         for (auto & entry : publisher->subscribers.load()->entries) entry.second(sender, message);
+      }
+
+   private:
+      ConcurrentMessageBus(ConcurrentMessageBus const &);
+      ConcurrentMessageBus & operator=(ConcurrentMessageBus const &);
+
+      template <typename Message>
+      struct SubscriberList : public impl::Retirable {
+         typedef std::pair<SubscriptionId, std::function<void(void*,Message const &)>> Entry;
+         std::vector<Entry> entries;
+      };
+
+      struct PublisherBase {
+         virtual ~PublisherBase() {}
+      };
+
+      template <typename Message>
+      struct Publisher : public PublisherBase {
+         Publisher() : subscribers(new SubscriberList<Message>{}) { }
+         ~Publisher() { delete subscribers.load(); }
+
+         std::atomic<SubscriberList<Message>*> subscribers;
+      };
+
+      // publishers are never removed, so only the table needs to be reclaimed
+      struct PublisherTable : public impl::Retirable {
+         // indexed by impl::MessageTypeSlot
+         std::vector<PublisherBase*> publishers;
+      };
+
+      template <typename Message>
+      static Publisher<Message>* findPublisher(PublisherTable const & table) {
+         auto slot = impl::MessageTypeSlot<Message>::value();
+         if (slot >= table.publishers.size()) return nullptr;
+         return static_cast<Publisher<Message>*>(table.publishers[slot]);
+      }
+
+      template <typename Message>
+      Publisher<Message>& findOrCreatePublisher() {
+         auto * current = table_.load();
+         if (auto * publisher = findPublisher<Message>(*current)) return *publisher;
+
+         auto * publisher = new Publisher<Message>{};
+         publishers_.push_back(std::unique_ptr<PublisherBase>(publisher));
+
+         auto slot = impl::MessageTypeSlot<Message>::value();
+         auto * updated = new PublisherTable(*current);
+         if (slot >= updated->publishers.size()) updated->publishers.resize(slot + 1, nullptr);
+         updated->publishers[slot] = publisher;
+         replace(table_, current, updated);
+
+         return *publisher;
+      }
+
+      // must be called with writeMutex_ held
+      template <typename T>
+      void replace(std::atomic<T*> & target, T * current, T * updated) {
+         target.store(updated);
+         retired_.retire(current);
+         retired_.reclaim();
+      }
+
+      std::atomic<PublisherTable*> table_;
+
+      std::mutex writeMutex_;
+      SubscriptionId nextSubscriptionId_;
+      std::vector<std::unique_ptr<PublisherBase>> publishers_;
+      impl::RetireList retired_;
+   };
+
+} // namespace pcx
+
+#endif // #ifndef PCX_CONCURRENT_MESSAGE_BUS_H
@@ -0,0 +1,267 @@
+#ifndef PCX_ENTITY_REGISTRY_H
+#define PCX_ENTITY_REGISTRY_H
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <pcx/IndexPool.h>
+#include <pcx/impl/ComponentStore.h>
+
+namespace pcx
+{
+   class ServiceRegistry;
+
+   /**
+    * @brief An entity handle, its IndexPool index plus the generation of that
+    * index, which is bumped each time an entity is destroyed so that stale handles
+    * are rejected rather than aliasing a newer entity
+    */
+   struct Entity
+   {
+      Entity() : index(~std::uint32_t(0)), generation(0) { }
+      Entity(std::uint32_t index, std::uint32_t generation) : index(index), generation(generation) { }
+
+      bool operator==(Entity const & other) const { return index == other.index && generation == other.generation; }
+      bool operator!=(Entity const & other) const { return !(*this == other); }
+
+      std::uint32_t index;
+      std::uint32_t generation;
+   };
+
+   /**
+    * @brief The EntityRegistry class hands out entities from an IndexPool and keeps
+    * their components, any number of types of them, each entity having at most
+    * one component of each type.
+    * Each component type has a store, found by its dense impl::ComponentTypeSlot,
+    * holding its components in one contiguous array alongside a sparse set of the
+    * entities that have one. view<A, B, C>() visits the entities having all of
+    * A, B and C by walking the smallest of the three stores and looking each of
+    * its entities up in the other two, so a query costs in proportion to the
+    * rarest component rather than to the number of entities.
+    * Components move as others of their type are removed, so references to them
+    * are only good until the next change to their store.
+    * An EntityRegistry can be added to a ServiceRegistry with add<EntityRegistry>().
+    */
+   class EntityRegistry
+   {
+   public:
+      template <typename... Components>
+      class View;
+
+      EntityRegistry();
+      explicit EntityRegistry(ServiceRegistry & services);
+
+      Entity create();
+
+      /// Removes all of the entity's components. @return false if the entity was stale
+      bool destroy(Entity entity);
+
+      bool isAlive(Entity entity) const;
+
+      /// The number of live entities
+      long size() const { return pool_.Size(); }
+
+      /// Throws if the entity is stale or already has a Component
+      template <typename Component, typename... Args>
+      Component & add(Entity entity, Args &&... args);
+
+      /// @return false if the entity was stale or had no Component
+      template <typename Component>
+      bool remove(Entity entity);
+
+      template <typename Component>
+      bool has(Entity entity) const;
+
+      /// @return the component, or nullptr if the entity is stale or has no Component
+      template <typename Component>
+      Component * find(Entity entity);
+
+      /// Throws if the entity is stale or has no Component
+      template <typename Component>
+      Component & get(Entity entity);
+
+      /// The number of entities with a Component
+      template <typename Component>
+      long count() const;
+
+      /// The entities having all of Components
+      template <typename... Components>
+      View<Components...> view() { return View<Components...>(*this); }
+
+   private:
+      EntityRegistry(EntityRegistry const &);
+      EntityRegistry & operator=(EntityRegistry const &);
+
+      template <typename Component>
+      impl::ComponentStore<Component> * findStore() const;
+      template <typename Component>
+      impl::ComponentStore<Component> & findOrCreateStore();
+
+      IndexPool pool_;
+      std::vector<std::uint32_t> generations_;                         // indexed by pool index
+      std::vector<std::unique_ptr<impl::BaseComponentStore>> stores_;  // indexed by component type slot
+   };
+
+   /**
+    * @brief The entities having all of a set of component types. A View holds no
+    * state of its own, so it sees entities and components added after it was made.
+    */
+   template <typename... Components>
+   class EntityRegistry::View
+   {
+      static_assert(sizeof...(Components) > 0, "A View needs at least one component type");
+
+   public:
+      explicit View(EntityRegistry & registry) : registry_(registry) { }
+
+      /**
+       * Calls f(Entity, Components &...) for each entity having all of Components,
+       * in no particular order. f may destroy the entity it is given or remove its
+       * components, but must not remove those of other entities. Components added
+       * by f may move those passed to it.
+       */
+      template <typename F>
+      void forEach(F f) { run(f, registry_.findStore<Components>()...); }
+
+      /// An upper bound on the number of entities in the view, the size of its smallest store
+      long sizeHint() const { return smallest(registry_.findStore<Components>()...); }
+
+   private:
+      template <typename F, typename... Stores>
+      void run(F & f, Stores *... stores);
+
+      static bool allExist() { return true; }
+      template <typename Store, typename... Rest>
+      static bool allExist(Store const * store, Rest const *... rest)
+      {
+         return nullptr != store && allExist(rest...);
+      }
+
+      static bool containsAll(std::uint32_t) { return true; }
+      template <typename Store, typename... Rest>
+      static bool containsAll(std::uint32_t index, Store const & store, Rest const &... rest)
+      {
+         return store.contains(index) && containsAll(index, rest...);
+      }
+
+      static impl::BaseComponentStore const * smallestOf(impl::BaseComponentStore const & store) { return &store; }
+      template <typename... Rest>
+      static impl::BaseComponentStore const * smallestOf(impl::BaseComponentStore const & store, Rest const &... rest)
+      {
+         auto other = smallestOf(rest...);
+         return other->size() < store.size() ? other : &store;
+      }
+
+      template <typename Store>
+      static long smallest(Store const * store) { return nullptr == store ? 0 : store->size(); }
+      template <typename Store, typename... Rest>
+      static long smallest(Store const * store, Rest const *... rest)
+      {
+         auto other = smallest(rest...);
+         return nullptr == store ? 0 : std::min(store->size(), other);
+      }
+
+      EntityRegistry & registry_;
+   };
+
+   //
+   // EntityRegistry Implementation
+   //
+
+   template <typename Component, typename... Args>
+   Component & EntityRegistry::add(Entity entity, Args &&... args)
+   {
+      if (!isAlive(entity)) throw std::runtime_error("EntityRegistry entity is not alive");
+
+      auto & store = findOrCreateStore<Component>();
+      if (store.contains(entity.index)) throw std::runtime_error("EntityRegistry entity already has this component");
+
+      return store.emplace(entity.index, std::forward<Args>(args)...);
+   }
+
+   template <typename Component>
+   bool EntityRegistry::remove(Entity entity)
+   {
+      if (!has<Component>(entity)) return false;
+      findStore<Component>()->remove(entity.index);
+      return true;
+   }
+
+   template <typename Component>
+   bool EntityRegistry::has(Entity entity) const
+   {
+      auto store = findStore<Component>();
+      return nullptr != store && isAlive(entity) && store->contains(entity.index);
+   }
+
+   template <typename Component>
+   Component * EntityRegistry::find(Entity entity)
+   {
+      return has<Component>(entity) ? &findStore<Component>()->get(entity.index) : nullptr;
+   }
+
+   template <typename Component>
+   Component & EntityRegistry::get(Entity entity)
+   {
+      auto component = find<Component>(entity);
+      if (nullptr == component) throw std::runtime_error("EntityRegistry entity does not have this component");
+      return *component;
+   }
+
+   template <typename Component>
+   long EntityRegistry::count() const
+   {
+      auto store = findStore<Component>();
+      return nullptr == store ? 0 : store->size();
+   }
+
+   template <typename Component>
+   impl::ComponentStore<Component> * EntityRegistry::findStore() const
+   {
+      auto slot = impl::ComponentTypeSlot<Component>::value();
+      if (slot >= stores_.size()) return nullptr;
+      return static_cast<impl::ComponentStore<Component>*>(stores_[slot].get());
+   }
+
+   template <typename Component>
+   impl::ComponentStore<Component> & EntityRegistry::findOrCreateStore()
+   {
+      auto slot = impl::ComponentTypeSlot<Component>::value();
+      if (slot >= stores_.size()) stores_.resize(slot + 1);
+
+      auto & store = stores_[slot];
+      if (!store) store.reset(new impl::ComponentStore<Component>());
+      return static_cast<impl::ComponentStore<Component>&>(*store);
+   }
+
+   //
+   // EntityRegistry::View Implementation
+   //
+
+   template <typename... Components>
+   template <typename F, typename... Stores>
+   void EntityRegistry::View<Components...>::run(F & f, Stores *... stores)
+   {
+      // a component type nothing has had yet has no store, and no entities in the view
+      if (!allExist(stores...)) return;
+
+      auto & walked = *smallestOf(*stores...);
+
+      // backwards, so that when f removes the entity it was given the one moved into
+      // its place has already been visited
+      for (auto position = walked.size(); position-- > 0;)
+      {
+         auto index = walked.entities()[position];
+         if (!containsAll(index, *stores...)) continue;
+
+         f(Entity(index, registry_.generations_[index]), stores->get(index)...);
+      }
+   }
+
+} // namespace pcx
+
+#endif // #ifndef PCX_ENTITY_REGISTRY_H
@@ -3,41 +3,194 @@
 
 #include <vector>
 #include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <memory>
 #include <numeric>
+#include <type_traits>
 #include <unordered_map>
 
+#include <pcx/Span.h>
+#include <pcx/impl/BitOps.h>
+#include <pcx/impl/HierarchicalBitmap.h>
+
 namespace pcx
 {
+   class WorkerPool;
+
+   /// Which free index an IndexPool hands out next
+   enum class AllocationPolicy {
+      Fifo,          ///< the one freed longest ago (or never used)
+      LowestFree,    ///< the lowest, keeping the allocated indices packed at the bottom of the pool
+   };
+
    /**
     * Still experimental, but intended to be used to efficiently track indexes into
     * other collections if objects in those collections are frequrently iterated over,
     * added and removed. This class is meant to house the logic of ensuring that
     * iteration over those indicies is always in a cache-friendly (sorted) order.
+    *
+    * A pool is either fixed, throwing once all of its indices are in use, or
+    * growable, adding chunks of indices as needed. Growing never moves the
+    * existing bookkeeping, and parallel arrays kept in a ChunkedArray of the same
+    * chunk size can grow alongside the pool without moving either.
+    *
+    * The bookkeeping is kept in arrays of Index, an unsigned type, so a pool of
+    * 32 bit indices (IndexPool) costs a little over 8 bytes per index. Its largest
+    * index is one less than the largest Index, which marks the end of a list.
+    * Indices are passed in and out as long whatever the Index type.
     */
-   class IndexPool
+   template <typename Index>
+   class BasicIndexPool
    {
+      static_assert(std::is_unsigned<Index>::value, "IndexPool indices are unsigned");
+
    public:
-      IndexPool(long size);
+      /// A fixed pool of size indices
+      BasicIndexPool(long size, AllocationPolicy policy = AllocationPolicy::Fifo);
+
+      /// A growable pool, starting with size indices (rounded up to whole chunks)
+      /// and adding chunkSize more whenever it is full. chunkSize must be a power of two
+      BasicIndexPool(long size, long chunkSize, AllocationPolicy policy = AllocationPolicy::Fifo);
 
       long Allocate();
       void Free(long index);
+
+      /**
+       * Allocates count indices into the start of out, in one operation. Either
+       * all of them are allocated or, if this throws, the pool is left unchanged
+       */
+      void Allocate(long count, Span<long> out);
+
+      /// Frees all of the indices or, if any of them is not allocated, none of them
+      void Free(Span<long const> indices);
       long Size() const { return size_; }
+      long Reserved() const { return reserved_; }
+
+      /// 0 for fixed pools
+      long ChunkSize() const { return growable_ ? chunkMask_ + 1 : 0; }
+
+      AllocationPolicy Policy() const { return policy_; }
 
+      /**
+       * Releases the chunks at the end of a growable pool that no longer hold any
+       * allocated index, down to the pool's starting size
+       * @return the number of indices reserved afterwards
+       */
+      long Shrink();
+
+      /**
+       * Moves the allocated indices down to 0 .. Size() - 1, keeping their order
+       * (and their allocation order). Follow with Shrink to release the chunks freed.
+       * @return a table of the new index of each old index, -1 for those that were
+       * free, see ApplyRemap. If this throws, the pool is left unchanged
+       */
+      std::vector<long> Compact();
+
+      /// The allocated indices in the order they were allocated
       long First() const { return allocListStart_; }
-      long Next(long index) const { return refList_.at(index).second; }
+      long Next(long index) const;
+
+      bool IsAllocated(long index) const { return index >= 0 && index < reserved_ && IsOccupied(index); }
 
+      /**
+       * Calls f(index) for each allocated index in ascending order, by scanning a
+       * bitmap of the allocated indices rather than following the allocation list.
+       * f must not allocate or free indices.
+       */
       template <typename T>
       void ForEach(T f)
       {
-         bool end = false;
-         for (auto idx = allocListStart_; !end; idx = refList_[idx].second)
+         long base = 0;
+         for (auto & chunk : chunks_)
          {
-            end = idx == allocListEnd_;
-            f(idx);
+            if (0 != chunk->used) impl::forEachSetBit(chunk->occupied.data(), chunk->occupied.size(), base, f);
+            base += static_cast<long>(chunk->next.size());
          }
       }
 
+      /**
+       * Calls f(index) for each allocated index, spread across the threads of a
+       * WorkerPool. The indices are cut into ranges of about grain allocated
+       * indices each, always at multiples of 64 indices (or at chunk boundaries,
+       * for chunks smaller than that), so no two ranges share a cache line of a
+       * cache line aligned parallel array. Each range is visited in ascending order.
+       * f must be thread safe and must not allocate or free indices. If f throws,
+       * the first exception is rethrown once every range has finished.
+       */
+      template <typename F>
+      void ParallelForEach(WorkerPool & workers, F f, long grain = 4096);
+
+      /**
+       * Like ParallelForEach, but each range folds its indices into its own
+       * accumulator, starting from identity, with f(T & acc, index). The ranges'
+       * results are then combined in ascending order with combine(T, T), so the
+       * result depends on grain but never on the number of threads or on how
+       * the ranges were scheduled.
+       */
+      template <typename T, typename F, typename C>
+      T ParallelReduce(WorkerPool & workers, T identity, F f, C combine, long grain = 4096);
+
    private:
+      // the end of a list
+      static const Index npos = std::numeric_limits<Index>::max();
+
+      struct Chunk
+      {
+         explicit Chunk(long size) : used(0), next(size, npos), prev(size, npos), occupied((size + 63) / 64, 0) { }
+
+         long used;
+         std::vector<Index> next;                  // links of the 'free' and 'alloc' lists
+         std::vector<Index> prev;                  // back links of the 'alloc' list
+         std::vector<std::uint64_t> occupied;      // a bit per allocated index
+      };
+
+      static long FromLink(Index link) { return npos == link ? -1 : static_cast<long>(link); }
+      static Index ToLink(long index) { return -1 == index ? npos : static_cast<Index>(index); }
+
+      long NextOf(long index) const { return FromLink(chunks_[index >> chunkShift_]->next[index & chunkMask_]); }
+      void SetNext(long index, long next) { chunks_[index >> chunkShift_]->next[index & chunkMask_] = ToLink(next); }
+      long PrevOf(long index) const { return FromLink(chunks_[index >> chunkShift_]->prev[index & chunkMask_]); }
+      void SetPrev(long index, long prev) { chunks_[index >> chunkShift_]->prev[index & chunkMask_] = ToLink(prev); }
+      Chunk & ChunkOf(long index) { return *chunks_[index >> chunkShift_]; }
+      void SetOccupied(long index, bool occupied)
+      {
+         auto offset = index & chunkMask_;
+         auto & word = chunks_[index >> chunkShift_]->occupied[offset / 64];
+         auto bit = std::uint64_t(1) << (offset % 64);
+         word = occupied ? word | bit : word & ~bit;
+      }
+
+      bool IsOccupied(long index) const
+      {
+         auto offset = index & chunkMask_;
+         return 0 != (chunks_[index >> chunkShift_]->occupied[offset / 64] & (std::uint64_t(1) << (offset % 64)));
+      }
+
+      // the occupied bitmap words of every chunk, one after another, are cut into
+      // ranges at these positions
+      std::vector<long> Partition(long grain) const;
+      void RunRanges(WorkerPool & workers, std::size_t count, std::function<void(std::size_t)> const & run) const;
+
+      template <typename F>
+      void ForEachInWords(long first, long last, F & f) const;
+
+      void AddChunk(long size);
+      // releases every chunk from count on, which must have nothing allocated
+      void ReleaseChunks(long count);
+
+      // adds an index just taken from the free indices to the 'alloc' list
+      void Link(long index);
+      // takes an allocated index out of the 'alloc' list, leaving it to the caller to add to the free indices
+      void Unlink(long index);
+
+      AllocationPolicy policy_;
+      bool growable_;
+      int   chunkShift_;
+      long  chunkMask_;
+      long  minChunks_;
+
       long  reserved_;
       long size_;
 
@@ -47,11 +200,148 @@ namespace pcx
       long  allocListStart_;
       long  allocListEnd_;
 
-      std::vector<std::pair<bool, long>> refList_;
-      // std::vector<long> refList_;
-      std::vector<long> backRefList_;
+      // the free indices, for the LowestFree policy (which has no 'free' list)
+      impl::HierarchicalBitmap free_;
+
+      // a fixed pool has a single chunk of all its indices
+      std::vector<std::unique_ptr<Chunk>> chunks_;
+   };
+
+   typedef BasicIndexPool<std::uint16_t> IndexPool16;
+   typedef BasicIndexPool<std::uint32_t> IndexPool;
+   typedef BasicIndexPool<std::uint64_t> IndexPool64;
+
+   // these are compiled in IndexPool.cpp
+   extern template class BasicIndexPool<std::uint16_t>;
+   extern template class BasicIndexPool<std::uint32_t>;
+   extern template class BasicIndexPool<std::uint64_t>;
+
+   /**
+    * @brief An array that grows and shrinks by whole chunks, so elements never move
+    * and references to them stay valid until their chunk is released. Meant for
+    * data kept in parallel with a growable IndexPool of the same chunk size.
+    */
+   template <typename T>
+   class ChunkedArray
+   {
+   public:
+      /// chunkSize must be a power of two
+      explicit ChunkedArray(long chunkSize);
+
+      /// The number of elements, always a whole number of chunks
+      long Size() const { return static_cast<long>(chunks_.size()) << chunkShift_; }
+
+      /// Adds or releases chunks to hold at least size elements; new elements are value initialised
+      void Resize(long size);
+
+      T & operator[](long index) { return chunks_[index >> chunkShift_][index & chunkMask_]; }
+      T const & operator[](long index) const { return chunks_[index >> chunkShift_][index & chunkMask_]; }
+
+   private:
+      int chunkShift_;
+      long chunkMask_;
+      std::vector<std::unique_ptr<T[]>> chunks_;
    };
 
+   /**
+    * Moves the elements of an array kept in parallel with an IndexPool to the
+    * indices the pool's Compact moved them to, in a single pass. Indices only
+    * ever move down, so elements are moved in ascending order of their old index.
+    */
+   template <typename Array>
+   void ApplyRemap(std::vector<long> const & remap, Array & data);
+
+   namespace impl
+   {
+      /// log2 of a power of two, throwing for anything else
+      int chunkShiftOf(long chunkSize);
+   } // namespace impl
+
+   //
+   // IndexPool Implementation
+   //
+
+   template <typename Index>
+   const Index BasicIndexPool<Index>::npos;
+
+   template <typename Index>
+   template <typename F>
+   void BasicIndexPool<Index>::ParallelForEach(WorkerPool & workers, F f, long grain)
+   {
+      auto cuts = Partition(grain);
+      RunRanges(workers, cuts.size() - 1, [&](std::size_t range)
+      {
+         auto visit = f;
+         ForEachInWords(cuts[range], cuts[range + 1], visit);
+      });
+   }
+
+   template <typename Index>
+   template <typename T, typename F, typename C>
+   T BasicIndexPool<Index>::ParallelReduce(WorkerPool & workers, T identity, F f, C combine, long grain)
+   {
+      auto cuts = Partition(grain);
+      std::vector<T> results(cuts.size() - 1, identity);
+      RunRanges(workers, results.size(), [&](std::size_t range)
+      {
+         auto acc = identity;
+         auto visit = [&](long index) { f(acc, index); };
+         ForEachInWords(cuts[range], cuts[range + 1], visit);
+         results[range] = std::move(acc);
+      });
+
+      auto result = identity;
+      for (auto & partial : results) result = combine(std::move(result), std::move(partial));
+      return result;
+   }
+
+   template <typename Index>
+   template <typename F>
+   void BasicIndexPool<Index>::ForEachInWords(long first, long last, F & f) const
+   {
+      auto wordsPerChunk = static_cast<long>(chunks_[0]->occupied.size());
+      auto chunkLength = static_cast<long>(chunks_[0]->next.size());
+
+      while (first < last)
+      {
+         auto chunk = first / wordsPerChunk;
+         auto word = first % wordsPerChunk;
+         auto count = std::min(last - first, wordsPerChunk - word);
+
+         auto const * words = chunks_[chunk]->occupied.data() + word;
+         impl::forEachSetBit(words, count, chunk * chunkLength + word * 64, f);
+         first += count;
+      }
+   }
+
+   template <typename Array>
+   void ApplyRemap(std::vector<long> const & remap, Array & data)
+   {
+      for (long index = 0; index < static_cast<long>(remap.size()); ++index)
+      {
+         auto to = remap[index];
+         if (-1 != to && to != index) data[to] = std::move(data[index]);
+      }
+   }
+
+   //
+   // ChunkedArray Implementation
+   //
+
+   template <typename T>
+   ChunkedArray<T>::ChunkedArray(long chunkSize)
+      : chunkShift_(impl::chunkShiftOf(chunkSize)), chunkMask_(chunkSize - 1)
+   {
+   }
+
+   template <typename T>
+   void ChunkedArray<T>::Resize(long size)
+   {
+      auto count = static_cast<std::size_t>((size + chunkMask_) >> chunkShift_);
+      while (chunks_.size() < count) chunks_.emplace_back(new T[chunkMask_ + 1]());
+      chunks_.resize(count);
+   }
+
 } // namespace pcx
 
 #endif // #ifndef PCX_INDEX_POOL_H
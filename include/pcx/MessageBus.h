@@ -1,52 +1,1199 @@
 #ifndef PCX_MESSAGE_BUS_H
 #define PCX_MESSAGE_BUS_H
 
-#include <list>
+#include <algorithm>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+#include <typeinfo>
 #include <unordered_map>
-#include <functional>
-#include <typeindex>
+#include <utility>
+#include <vector>
+
+#include <pcx/MessageBusMetrics.h>
+#include <pcx/Span.h>
+#include <pcx/TimerWheel.h>
+#include <pcx/Utils.h>
+#include <pcx/WorkerPool.h>
+#include <pcx/impl/InplaceFunction.h>
+#include <pcx/impl/MessageTypeSlot.h>
+#include <pcx/impl/MessageWaiter.h>
 
 namespace pcx
 {
+   namespace impl
+   {
+      /// Implemented by whatever holds the subscriber a Subscription refers to
+      class SubscriptionOwner {
+      public:
+         virtual void unsubscribe(std::uint32_t index, std::uint32_t generation) = 0;
+
+      protected:
+         ~SubscriptionOwner() {}
+      };
+   } // namespace impl
+
+   /**
+    * @brief Scoped handle to a MessageBus subscription: the subscriber is removed
+    * when the Subscription is destroyed or reset.
+    * A Subscription must not outlive its bus; call release() to leave the subscriber
+    * in place for the lifetime of the bus instead.
+    */
+   class Subscription {
+   public:
+      Subscription() : owner_(nullptr), index_(0), generation_(0) { }
+      Subscription(impl::SubscriptionOwner & owner, std::uint32_t index, std::uint32_t generation)
+         : owner_(&owner), index_(index), generation_(generation) { }
+
+      Subscription(Subscription && other)
+         : owner_(other.owner_), index_(other.index_), generation_(other.generation_) {
+         other.owner_ = nullptr;
+      }
+
+      Subscription & operator=(Subscription && other) {
+         if (this != &other) {
+            reset();
+            owner_ = other.owner_;
+            index_ = other.index_;
+            generation_ = other.generation_;
+            other.owner_ = nullptr;
+         }
+         return *this;
+      }
+
+      ~Subscription() { reset(); }
+
+      void reset() {
+         if (owner_) owner_->unsubscribe(index_, generation_);
+         owner_ = nullptr;
+      }
+
+      void release() { owner_ = nullptr; }
+
+      bool active() const { return nullptr != owner_; }
+
+   private:
+      Subscription(Subscription const &);
+      Subscription & operator=(Subscription const &);
+
+      impl::SubscriptionOwner * owner_;
+      std::uint32_t index_;
+      std::uint32_t generation_;
+   };
+
+   /**
+    * @brief How a subscriber is called relative to the publishing thread
+    */
+   enum class DispatchPolicy {
+      Inline,            // on the publishing thread, one after another
+      ParallelJoin,      // on the bus' WorkerPool, publish waits for completion
+      ParallelDetached   // on the bus' WorkerPool with a copy of the message, publish does not wait
+   };
+
+   /**
+    * @brief Where a coroutine waiting on MessageBus::next is resumed
+    */
+   enum class ResumeOn {
+      Publish,           // inside publish (or the drain delivering a queued message), after the subscribers
+      DispatchPending    // at the end of the next dispatchPending
+   };
+
+   /**
+    * @brief What enqueue does when a bounded message queue is full
+    */
+   enum class OverflowPolicy {
+      Block,         // wait for the next dispatchPending to make room
+      DropOldest,    // discard the oldest queued message to make room
+      DropNewest,    // discard the message being enqueued
+      Fail           // reject the message being enqueued, reporting EnqueueResult::Rejected
+   };
+
+   enum class EnqueueResult {
+      Queued,        // will be delivered (under DropOldest another message may have been discarded)
+      Dropped,       // the queue was full and the message was discarded (DropNewest)
+      Rejected       // the queue was full and the message was not queued (Fail)
+   };
+
+   /**
+    * @brief Counters for a bounded message queue
+    */
+   struct QueueStats {
+      std::size_t pending;       // messages waiting for dispatchPending
+      std::uint64_t dropped;     // messages discarded or rejected because the queue was full
+      std::uint64_t blocked;     // enqueues that had to wait for room
+   };
+
    /**
     * @brief The MessageBus class is used to send cross-component messages.
     * Users subscribe with a simple callback, and are notified of messages
     * (and the sender of that message) as a result of invocation of the
-    * publish method
+    * publish method.
+    * Messages may instead be queued with enqueue, in which case they are
+    * delivered when dispatchPending is next called (typically once per frame).
+    * Queued messages are delivered type by type, each type's messages in the
+    * order they were enqueued. Types registered as conflating (setConflating) only
+    * deliver the latest queued message from each sender.
+    * Queues grow without limit unless given a capacity (setQueueCapacity), in which
+    * case an OverflowPolicy decides what happens to messages that don't fit.
+    * Each message type is looked up by its dense impl::MessageTypeSlot; frequent
+    * publishers can hold a Channel to skip even that.
+    * Subscribers are held in a contiguous array per message type, and callbacks
+    * small enough (a few captured pointers, or a bound member function) are stored
+    * inline, so neither subscribing nor publishing allocates per subscriber.
+    * Unsubscribing moves the last subscriber into the gap, so subscribers are called
+    * in subscription order only until one of their message type is removed; after
+    * that the order is unspecified.
+    * Many messages of one type can be published together with publishBatch, and
+    * batch subscribers (subscribeBatch) receive them in a single call.
+    * Subscribers may also listen to a single sender, in which case they are found
+    * through a per-type index keyed by sender rather than filtering every message.
+    * Handlers may subscribe and unsubscribe, and publish further messages, while a
+    * message is being dispatched. Subscribers removed during dispatch are not called
+    * again, even by nested publishes; subscribers added during dispatch are only
+    * called once the outermost publish of their message type has returned.
+    * Expensive, independent subscribers can be run in parallel on a WorkerPool
+    * (see DispatchPolicy and setWorkerPool); these must be thread safe. Inline
+    * subscribers are unaffected and still run one at a time on the publishing thread.
+    * When built with PCX_MESSAGE_BUS_METRICS, per message type dispatch counts and
+    * timings are kept (see metrics()); otherwise none of that code is compiled in.
+    * C++20 coroutines can wait for a message with co_await bus.next<Message>() (see
+    * pcx/Routine.h for a coroutine type to run them in).
+    * Messages can be published after a delay, or repeatedly, with publishAfter and
+    * publishEvery; these are kept on a TimerWheel driven by advanceTimers, which
+    * should be called from the frame loop.
     */
    class MessageBus {
+      template <typename Message>
+      struct Publisher;
+
    public:
+      /**
+       * @brief A typed handle to a single message type's publisher, valid for the
+       * lifetime of the bus that created it
+       */
       template <typename Message>
-      void subscribe(std::function<void(void*,Message const &)> callback) {
-         auto it = publishers_.find(typeid(Message));
-         if (it == publishers_.end()) {
-            publishers_[typeid(Message)] = new Publisher<Message>{};
-            it = publishers_.find(typeid(Message));
+      class Channel {
+      public:
+         Channel() : bus_(nullptr), publisher_(nullptr) { }
+
+         void publish(void* sender, Message const & message) {
+            publisher_->publish(sender, message);
          }
-         auto & publisher = *reinterpret_cast<Publisher<Message>*>(it->second);
-         publisher.subscribers.push_back(callback);
+
+         void publishBatch(void* sender, Span<Message const> messages) {
+            publisher_->publishBatch(sender, messages);
+         }
+
+         EnqueueResult enqueue(void* sender, Message message) {
+            return bus_->enqueueTo(*publisher_, sender, std::move(message));
+         }
+
+      private:
+         friend class MessageBus;
+         Channel(MessageBus & bus, Publisher<Message> & publisher) : bus_(&bus), publisher_(&publisher) { }
+
+         MessageBus * bus_;
+         Publisher<Message> * publisher_;
+      };
+
+      /**
+       * @brief Awaitable for the next Message published: co_await yields a copy of it.
+       * The wait is linked into the bus from the coroutine frame, so suspending
+       * allocates nothing, and destroying a suspended coroutine cancels its wait.
+       * Suspended coroutines must not outlive the bus.
+       */
+      template <typename Message>
+      class Next : private impl::MessageWaiter {
+      public:
+         // only to return from next(); a suspended Next must not move
+         Next(Next && other) : impl::MessageWaiter(other.sender, other.anySender, other.deferred), publisher_(other.publisher_), received_(false) { }
+
+         ~Next() {
+            if (list) list->remove(*this);
+            if (received_) message().~Message();
+         }
+
+         bool await_ready() const { return false; }
+
+         template <typename Handle>
+         void await_suspend(Handle handle) {
+            coroutine = handle.address();
+            resume = [](void* address) { Handle::from_address(address).resume(); };
+            deliver = &Next::deliverTo;
+            publisher_->waiters.push_back(*this);
+         }
+
+         Message await_resume() { return std::move(message()); }
+
+      private:
+         friend class MessageBus;
+         Next(Publisher<Message> & publisher, void* sender, bool anySender, ResumeOn resumeOn)
+            : impl::MessageWaiter(sender, anySender, ResumeOn::DispatchPending == resumeOn)
+            , publisher_(&publisher), received_(false) { }
+
+         Next(Next const &);
+         Next & operator=(Next const &);
+
+         static void deliverTo(impl::MessageWaiter & waiter, void*, void const * message) {
+            auto & self = static_cast<Next&>(waiter);
+            new (&self.storage_) Message(*static_cast<Message const*>(message));
+            self.received_ = true;
+         }
+
+         Message & message() { return *reinterpret_cast<Message*>(&storage_); }
+
+         Publisher<Message> * publisher_;
+         typename std::aligned_storage<sizeof(Message), alignof(Message)>::type storage_;
+         bool received_;
+      };
+
+      MessageBus() : workerPool_(nullptr), dispatching_(false) { }
+
+      /**
+       * Sets the pool parallel subscribers are run on. Without one they are run
+       * on the publishing thread after the inline subscribers.
+       */
+      void setWorkerPool(WorkerPool * pool) {
+         workerPool_ = pool;
+         for (auto & publisher : publishers_) {
+            if (publisher) publisher->workerPool = pool;
+         }
+      }
+
+      /**
+       * Subscribes callback(void* sender, Message const &) until the returned
+       * Subscription is destroyed. Subscribing from inside a handler is allowed;
+       * the new subscriber will not see the message being dispatched (or any
+       * published while handling it).
+       */
+      template <typename Message, typename Callback>
+      PCX_NODISCARD Subscription subscribe(Callback callback) {
+         auto & publisher = findOrCreatePublisher<Message>();
+         return publisher.add(typename Publisher<Message>::CallbackT(std::move(callback)));
+      }
+
+      /// Subscribes object.Method(void* sender, Message const &)
+      template <typename Message, typename T, void (T::*Method)(void*, Message const &)>
+      PCX_NODISCARD Subscription subscribe(T & object) {
+         auto & publisher = findOrCreatePublisher<Message>();
+         return publisher.add(Publisher<Message>::CallbackT::template bind<T, Method>(object));
+      }
+
+      /**
+       * Subscribes callback with the given dispatch policy. Parallel subscribers
+       * are started before the inline subscribers run, in no particular order.
+       */
+      template <typename Message, typename Callback>
+      PCX_NODISCARD Subscription subscribe(Callback callback, DispatchPolicy policy) {
+         auto & publisher = findOrCreatePublisher<Message>();
+         return publisher.add(publisher.listFor(policy), typename Publisher<Message>::CallbackT(std::move(callback)));
+      }
+
+      /**
+       * Subscribes callback to messages published by sender only. These subscribers
+       * are called after those subscribed to all senders.
+       */
+      template <typename Message, typename Callback>
+      PCX_NODISCARD Subscription subscribe(void* sender, Callback callback) {
+         auto & publisher = findOrCreatePublisher<Message>();
+         return publisher.add(sender, typename Publisher<Message>::CallbackT(std::move(callback)));
+      }
+
+      template <typename Message, typename T, void (T::*Method)(void*, Message const &)>
+      PCX_NODISCARD Subscription subscribe(void* sender, T & object) {
+         auto & publisher = findOrCreatePublisher<Message>();
+         return publisher.add(sender, Publisher<Message>::CallbackT::template bind<T, Method>(object));
+      }
+
+      /**
+       * Subscribes callback(void* sender, Span<Message const>), which is given all
+       * the messages of a publishBatch in one call. Messages published singly are
+       * passed as a span of one, and queued messages as runs from the same sender.
+       */
+      template <typename Message, typename Callback>
+      PCX_NODISCARD Subscription subscribeBatch(Callback callback) {
+         auto & publisher = findOrCreatePublisher<Message>();
+         return publisher.add(publisher.batch, typename Publisher<Message>::BatchCallbackT(std::move(callback)));
       }
 
       template <typename Message>
       void publish(void* sender, Message const & message) {
-         auto it = publishers_.find(typeid(Message));
-         if (it == publishers_.end()) return;
+         auto slot = impl::MessageTypeSlot<Message>::value();
+         if (slot >= publishers_.size() || !publishers_[slot]) return;
 
-         auto & publisher = *reinterpret_cast<Publisher<Message>*>(it->second);
+         auto & publisher = static_cast<Publisher<Message>&>(*publishers_[slot]);
          publisher.publish(sender, message);
       }
 
+      /**
+       * Publishes each of messages from sender. Other subscribers see the messages one
+       * at a time, in order, before batch subscribers are called with all of them.
+       */
+      template <typename Message>
+      void publishBatch(void* sender, Span<Message const> messages) {
+         auto slot = impl::MessageTypeSlot<Message>::value();
+         if (slot >= publishers_.size() || !publishers_[slot]) return;
+
+         auto & publisher = static_cast<Publisher<Message>&>(*publishers_[slot]);
+         publisher.publishBatch(sender, messages);
+      }
+
+      template <typename Message>
+      Channel<Message> channel() {
+         return Channel<Message>(*this, findOrCreatePublisher<Message>());
+      }
+
+      /// co_await bus.next<Message>() suspends until the next Message is published
+      template <typename Message>
+      Next<Message> next(ResumeOn resumeOn = ResumeOn::Publish) {
+         return Next<Message>(findOrCreatePublisher<Message>(), nullptr, true, resumeOn);
+      }
+
+      /// Waits for the next Message published by sender
+      template <typename Message>
+      Next<Message> next(void* sender, ResumeOn resumeOn = ResumeOn::Publish) {
+         return Next<Message>(findOrCreatePublisher<Message>(), sender, false, resumeOn);
+      }
+
+      /**
+       * Queues a message for delivery by the next call to dispatchPending.
+       * Messages enqueued by handlers during dispatchPending are held over
+       * until the following call.
+       * @return whether the message was queued, which it always is unless the type
+       * has a bounded queue (see setQueueCapacity)
+       */
+      template <typename Message>
+      EnqueueResult enqueue(void* sender, Message message) {
+         return enqueueTo(findOrCreatePublisher<Message>(), sender, std::move(message));
+      }
+
+      /**
+       * Limits the number of Message that may wait for dispatchPending, applying
+       * policy to any that don't fit. Conflated messages never overflow the queue.
+       * Once bounded, Message may be enqueued from other threads through a Channel
+       * created beforehand, while this thread runs dispatchPending. Bounded types are
+       * delivered after all unbounded ones.
+       * OverflowPolicy::Block is only useful with such producer threads: enqueueing to
+       * a full queue from the thread that set the capacity or last ran dispatchPending
+       * throws instead of deadlocking.
+       */
+      template <typename Message>
+      void setQueueCapacity(std::size_t capacity, OverflowPolicy policy) {
+         if (0 == capacity) throw std::runtime_error("MessageBus queue capacity must be at least 1");
+
+         auto & publisher = findOrCreatePublisher<Message>();
+         if (!publisher.bounds) {
+            publisher.bounds.reset(new QueueBounds{});
+            bounded_.push_back(&publisher);
+         }
+
+         std::lock_guard<std::mutex> lock(publisher.bounds->mutex);
+         // new messages are appended, so a ring that is no longer full has to be unwound
+         publisher.unwrapPending();
+         publisher.bounds->capacity = capacity;
+         publisher.bounds->policy = policy;
+         publisher.bounds->dispatchThread = std::this_thread::get_id();
+         publisher.bounds->space.notify_all();
+      }
+
+      /// Counters for a bounded message type (all zero for unbounded types)
+      template <typename Message>
+      QueueStats queueStats() {
+         auto & publisher = findOrCreatePublisher<Message>();
+         if (!publisher.bounds) return QueueStats{ publisher.pendingMessages.size(), 0, 0 };
+
+         std::lock_guard<std::mutex> lock(publisher.bounds->mutex);
+         return QueueStats{ publisher.pendingMessages.size(), publisher.bounds->dropped, publisher.bounds->blocked };
+      }
+
+      /**
+       * Registers Message as conflating (or not): when enqueued, a message replaces
+       * any message from the same sender still waiting to be dispatched, taking its
+       * place in the queue. Useful for state where only the latest value matters.
+       * Messages published directly are not affected. For bounded types this may be
+       * called while other threads enqueue through a Channel.
+       */
+      template <typename Message>
+      void setConflating(bool conflating = true) {
+         auto & publisher = findOrCreatePublisher<Message>();
+
+         // producer threads may be enqueueing to a bounded type
+         std::unique_lock<std::mutex> lock;
+         if (publisher.bounds) lock = std::unique_lock<std::mutex>(publisher.bounds->mutex);
+
+         publisher.conflating = conflating;
+         publisher.rebuildPendingIndex();
+      }
+
+      /**
+       * Delivers all messages queued before this call.
+       * @return the number of messages delivered
+       */
+      std::size_t dispatchPending() {
+         if (dispatching_ || (queued_.empty() && bounded_.empty() && ready_.empty())) return 0;
+
+         struct DispatchScope {
+            DispatchScope(bool & flag) : flag_(flag) { flag_ = true; }
+            ~DispatchScope() { flag_ = false; }
+            bool & flag_;
+         } scope(dispatching_);
+
+         // every type's queue is taken before any message is delivered, so messages
+         // that handlers enqueue, of any type, start a new queued list and are held over
+         draining_.clear();
+         std::swap(draining_, queued_);
+         for (auto * publisher : draining_) publisher->takePending();
+
+         // bounded queues may be filled from other threads, so are always checked
+         auto boundedCount = bounded_.size();
+         for (std::size_t i = 0; i < boundedCount; ++i) bounded_[i]->takePending();
+
+         std::size_t delivered = 0;
+         for (auto * publisher : draining_) delivered += publisher->dispatchPending();
+         for (std::size_t i = 0; i < boundedCount; ++i) delivered += bounded_[i]->dispatchPending();
+
+         resumeReady();
+         return delivered;
+      }
+
+      /**
+       * Publishes message from sender once delay has passed, as measured by
+       * advanceTimers (in whole milliseconds, rounded up).
+       * @return an id for cancelTimer
+       */
+      template <typename Message>
+      TimerId publishAfter(TimerWheel::Duration delay, void* sender, Message message) {
+         auto & publisher = findOrCreatePublisher<Message>();
+         return timers_.schedule(delay, [&publisher, sender, message]() { publisher.publish(sender, message); });
+      }
+
+      /// Publishes message from sender every interval, starting one interval from now
+      template <typename Message>
+      TimerId publishEvery(TimerWheel::Duration interval, void* sender, Message message) {
+         return publishEvery(interval, interval, sender, std::move(message));
+      }
+
+      /// Publishes message from sender after delay, then every interval
+      template <typename Message>
+      TimerId publishEvery(TimerWheel::Duration delay, TimerWheel::Duration interval, void* sender, Message message) {
+         auto & publisher = findOrCreatePublisher<Message>();
+         return timers_.scheduleRepeating(delay, interval, [&publisher, sender, message]() { publisher.publish(sender, message); });
+      }
+
+      /// @return false if the message was already published (or cancelled)
+      bool cancelTimer(TimerId id) {
+         return timers_.cancel(id);
+      }
+
+      /**
+       * Moves the bus' timers forward, publishing any scheduled messages that come due.
+       * @return the number of messages published
+       */
+      std::size_t advanceTimers(TimerWheel::Duration elapsed) {
+         return timers_.advance(elapsed);
+      }
+
+      /**
+       * Takes the time in seconds, as given to Module::update. Not an overload of
+       * advanceTimers, which a plain number like 16 would otherwise pick silently.
+       */
+      std::size_t advanceTimersSeconds(double timeSinceLast) {
+         return timers_.advance(std::chrono::duration_cast<TimerWheel::Duration>(std::chrono::duration<double>(timeSinceLast)));
+      }
+
+      /**
+       * A snapshot of every message type's dispatch metrics; empty unless built
+       * with PCX_MESSAGE_BUS_METRICS. Only types with subscribers (or channels,
+       * queues or other settings) are reported.
+       */
+      std::vector<MessageTypeMetrics> metrics() const {
+         std::vector<MessageTypeMetrics> result;
+#if PCX_MESSAGE_BUS_METRICS
+         for (auto & publisher : publishers_) {
+            if (!publisher) continue;
+            result.push_back(MessageTypeMetrics{});
+            publisher->snapshot(result.back());
+         }
+#endif
+         return result;
+      }
+
+      void resetMetrics() {
+#if PCX_MESSAGE_BUS_METRICS
+         for (auto & publisher : publishers_) {
+            if (!publisher) continue;
+            auto timeSubscribers = publisher->metrics.timeSubscribers;
+            publisher->metrics = impl::DispatchMetrics{};
+            setSubscriberTiming(*publisher, timeSubscribers);
+         }
+#endif
+      }
+
+      /**
+       * Enables per-subscriber latency histograms, which costs two clock reads per
+       * inline subscriber call. Does nothing unless built with PCX_MESSAGE_BUS_METRICS.
+       */
+      template <typename Message>
+      void setSubscriberTiming(bool enabled) {
+#if PCX_MESSAGE_BUS_METRICS
+         setSubscriberTiming(findOrCreatePublisher<Message>(), enabled);
+#else
+         (void)enabled;
+#endif
+      }
+
    private:
+      struct PublisherBase : public impl::SubscriptionOwner {
+         PublisherBase() : workerPool(nullptr), ready(nullptr), taken(false) { }
+         virtual ~PublisherBase() {}
+
+         /// Takes the queued messages for the next dispatchPending to deliver
+         virtual void takePending() = 0;
+         /// Delivers the messages taken by takePending
+         virtual std::size_t dispatchPending() = 0;
+
+         WorkerPool * workerPool;
+         impl::WaiterList * ready;    // the bus' list of waiters to resume in dispatchPending
+         bool taken;                  // between takePending and dispatchPending
+
+#if PCX_MESSAGE_BUS_METRICS
+         virtual void snapshot(MessageTypeMetrics & result) const = 0;
+         virtual std::size_t handleCount() const = 0;
+         impl::DispatchMetrics metrics;
+#endif
+      };
+
+#if PCX_MESSAGE_BUS_METRICS
+      static void setSubscriberTiming(PublisherBase & publisher, bool enabled) {
+         publisher.metrics.timeSubscribers = enabled;
+         publisher.metrics.subscriberLatency.assign(enabled ? publisher.handleCount() : 0, LatencyHistogram{});
+      }
+#endif
+
+      /**
+       * Maps stable subscription handles to positions in dense arrays, so that
+       * subscribers can be removed by swapping in the last element
+       */
+      struct HandleTable {
+         struct Slot {
+            void * list;               // the array the position refers to
+            std::uint32_t position;    // next free slot while unused
+            std::uint32_t generation;
+         };
+
+         static const std::uint32_t npos = ~std::uint32_t(0);
+
+         HandleTable() : freeSlot(npos) { }
+
+         // list is null while the subscriber is waiting to be added
+         std::uint32_t acquire(void * list, std::uint32_t position) {
+            if (npos == freeSlot) {
+               slots.push_back(Slot{ list, position, 0 });
+               return static_cast<std::uint32_t>(slots.size() - 1);
+            }
+            auto index = freeSlot;
+            freeSlot = slots[index].position;
+            slots[index].list = list;
+            slots[index].position = position;
+            return index;
+         }
+
+         void release(std::uint32_t index) {
+            ++slots[index].generation;
+            slots[index].position = freeSlot;
+            freeSlot = index;
+         }
+
+         bool valid(std::uint32_t index, std::uint32_t generation) const {
+            return index < slots.size() && slots[index].generation == generation;
+         }
+
+         std::vector<Slot> slots;
+         std::uint32_t freeSlot;
+      };
+
+      /**
+       * State for a bounded queue, which is the only state of a publisher that
+       * may be touched from other threads. Guards the pending buffers.
+       */
+      struct QueueBounds {
+         QueueBounds() : capacity(0), policy(OverflowPolicy::Fail), oldest(0), dropped(0), blocked(0) { }
+
+         std::mutex mutex;
+         std::condition_variable space;
+         std::size_t capacity;
+         OverflowPolicy policy;
+         // DropOldest overwrites a full buffer as a ring: the position of the oldest message
+         std::size_t oldest;
+         std::uint64_t dropped;
+         std::uint64_t blocked;
+         std::thread::id dispatchThread;
+      };
+
       template <typename Message>
-      struct Publisher {
-         std::list<std::function<void(void*,Message const &)>> subscribers;
+      struct Publisher : public PublisherBase {
+         typedef impl::InplaceFunction<void(void*, Message const &)> CallbackT;
+         typedef impl::InplaceFunction<void(void*, Span<Message const>)> BatchCallbackT;
+
+         // so that growing a subscriber vector moves its callbacks rather than copying them
+         static_assert(std::is_nothrow_move_constructible<CallbackT>::value, "CallbackT must move without throwing");
+
+         template <typename Callback>
+         struct BasicSubscriberList {
+            typedef Callback CallbackType;
+
+            struct Subscriber {
+               Callback callback;
+               std::uint32_t handle;      // HandleTable::npos once unsubscribed during dispatch
+            };
+
+            BasicSubscriberList() : sender(nullptr), indexed(false) { }
+
+            std::vector<Subscriber> subscribers;
+            void* sender;
+            bool indexed;     // lives in bySender
+         };
+
+         typedef BasicSubscriberList<CallbackT> SubscriberList;
+         typedef BasicSubscriberList<BatchCallbackT> BatchSubscriberList;
+
+         SubscriberList anySender;
+         SubscriberList parallelJoin;
+         SubscriberList parallelDetached;
+         // node based, so lists don't move as senders come and go
+         std::unordered_map<void*, SubscriberList> bySender;
+         BatchSubscriberList batch;
+         HandleTable handles;
+
+         // double buffered queue: enqueue appends to the pending buffers, which
+         // are swapped out for the draining buffers at dispatch time
+         std::vector<void*> pendingSenders;
+         std::vector<Message> pendingMessages;
+         std::vector<void*> drainingSenders;
+         std::vector<Message> drainingMessages;
+         std::size_t drainingOldest;      // where a wrapped DropOldest queue starts
+
+         // for conflating types, where each sender's pending message is
+         bool conflating;
+         std::unordered_map<void*, std::size_t> pendingIndex;
+
+         std::unique_ptr<QueueBounds> bounds;
+
+         // coroutines waiting for the next message (see Next)
+         impl::WaiterList waiters;
+
+         // while dispatching, subscriber lists are not modified: removed subscribers
+         // are marked, and new ones held here, until the outermost publish returns
+         template <typename List>
+         struct PendingAdd {
+            List * list;
+            typename List::Subscriber subscriber;
+            std::uint32_t generation;
+         };
+
+         unsigned dispatchDepth;
+         bool changesPending;
+         std::vector<PendingAdd<SubscriberList>> pendingAdds;
+         std::vector<PendingAdd<BatchSubscriberList>> pendingBatchAdds;
+         std::vector<SubscriberList*> dirtyLists;
+         bool batchDirty;
+
+         struct PublishScope {
+            PublishScope(Publisher & publisher) : publisher_(publisher) { ++publisher_.dispatchDepth; }
+            ~PublishScope() {
+               if (0 == --publisher_.dispatchDepth && publisher_.changesPending) publisher_.applyPendingChanges();
+            }
+            Publisher & publisher_;
+         };
+
+         Publisher() : drainingOldest(0), conflating(false), dispatchDepth(0), changesPending(false), batchDirty(false) { }
+
+         void enqueue(void* sender, Message message) {
+            if (conflating) {
+               auto inserted = pendingIndex.insert(std::make_pair(sender, pendingMessages.size()));
+               if (!inserted.second) {
+                  replace(pendingMessages[inserted.first->second], std::move(message),
+                     typename std::is_move_assignable<Message>::type());
+                  return;
+               }
+            }
+
+            pendingSenders.push_back(sender);
+            pendingMessages.push_back(std::move(message));
+         }
+
+         EnqueueResult enqueueBounded(void* sender, Message message) {
+            std::unique_lock<std::mutex> lock(bounds->mutex);
+
+            if (pendingMessages.size() >= bounds->capacity && !(conflating && pendingIndex.count(sender))) {
+               switch (bounds->policy) {
+               case OverflowPolicy::Block:
+                  if (std::this_thread::get_id() == bounds->dispatchThread) {
+                     throw std::runtime_error("MessageBus queue full, blocking would deadlock the dispatching thread");
+                  }
+                  ++bounds->blocked;
+                  bounds->space.wait(lock, [&]() {
+                     return pendingMessages.size() < bounds->capacity || (conflating && pendingIndex.count(sender));
+                  });
+                  break;
+               case OverflowPolicy::DropOldest:
+                  ++bounds->dropped;
+                  overwriteOldest(sender, std::move(message));
+                  return EnqueueResult::Queued;
+               case OverflowPolicy::DropNewest:
+                  ++bounds->dropped;
+                  return EnqueueResult::Dropped;
+               case OverflowPolicy::Fail:
+                  ++bounds->dropped;
+                  return EnqueueResult::Rejected;
+               }
+            }
+
+            enqueue(sender, std::move(message));
+            return EnqueueResult::Queued;
+         }
+
+         void overwriteOldest(void* sender, Message && message) {
+            auto position = bounds->oldest;
+            if (conflating) {
+               pendingIndex.erase(pendingSenders[position]);
+               pendingIndex[sender] = position;
+            }
+            pendingSenders[position] = sender;
+            replace(pendingMessages[position], std::move(message), typename std::is_move_assignable<Message>::type());
+            bounds->oldest = (position + 1) % pendingMessages.size();
+         }
+
+         // puts the oldest message of a DropOldest ring back at the front of the
+         // pending buffers (called with bounds->mutex held)
+         void unwrapPending() {
+            auto oldest = bounds->oldest;
+            if (0 == oldest) return;
+
+            // messages may not be assignable, so they are moved into a new buffer
+            std::vector<Message> messages;
+            messages.reserve(pendingMessages.capacity());
+            for (std::size_t i = 0; i < pendingMessages.size(); ++i) {
+               messages.push_back(std::move(pendingMessages[(oldest + i) % pendingMessages.size()]));
+            }
+            pendingMessages.swap(messages);
+            std::rotate(pendingSenders.begin(), pendingSenders.begin() + oldest, pendingSenders.end());
+            bounds->oldest = 0;
+
+            rebuildPendingIndex();
+         }
+
+         void rebuildPendingIndex() {
+            pendingIndex.clear();
+            if (!conflating) return;
+            for (std::size_t i = 0; i < pendingSenders.size(); ++i) pendingIndex[pendingSenders[i]] = i;
+         }
+
+         static void replace(Message & target, Message && value, std::true_type) {
+            target = std::move(value);
+         }
+
+         static void replace(Message & target, Message && value, std::false_type) {
+            target.~Message();
+            new (&target) Message(std::move(value));
+         }
 
          void publish(void* sender, Message const & message) {
-            for (auto & sub : subscribers) sub(sender, message);
+            publishBatch(sender, Span<Message const>(&message, 1));
+         }
+
+         void publishBatch(void* sender, Span<Message const> messages) {
+#if PCX_MESSAGE_BUS_METRICS
+            impl::DispatchTimer timer(metrics, messages.size());
+#endif
+            PublishScope scope(*this);
+
+            for (auto & message : messages) {
+               if (!parallelJoin.subscribers.empty() || !parallelDetached.subscribers.empty()) {
+                  publishParallel(sender, message);
+               }
+               else {
+                  dispatchInline(sender, message);
+               }
+
+               if (!waiters.empty()) wake(sender, message);
+            }
+
+            if (!batch.subscribers.empty()) {
+               auto & subscribers = batch.subscribers;
+               auto count = subscribers.size();
+               for (std::size_t i = 0; i < count; ++i) {
+                  if (HandleTable::npos != subscribers[i].handle) subscribers[i].callback(sender, messages);
+               }
+            }
+         }
+
+         void wake(void* sender, Message const & message) {
+            // sorted before anything is resumed, so that coroutines waiting again
+            // don't see this message
+            impl::WaiterList all, resumeNow, resumeLater;
+            all.splice(waiters);
+            while (auto * waiter = all.pop_front()) {
+               if (!waiter->matches(sender)) waiters.push_back(*waiter);
+               else if (waiter->deferred) resumeLater.push_back(*waiter);
+               else resumeNow.push_back(*waiter);
+            }
+
+            try {
+               // each waiter stays in waiters until it has its copy of the message
+               while (auto * waiter = resumeLater.pop_front()) {
+                  waiters.push_back(*waiter);
+                  waiter->deliver(*waiter, sender, &message);
+                  ready->push_back(*waiter);
+               }
+               while (auto * waiter = resumeNow.pop_front()) {
+                  waiters.push_back(*waiter);
+                  waiter->deliver(*waiter, sender, &message);
+                  waiters.remove(*waiter);
+                  waiter->resume(waiter->coroutine);
+               }
+            }
+            catch (...) {
+               waiters.splice(resumeLater);
+               waiters.splice(resumeNow);
+               throw;
+            }
+         }
+
+         void dispatchInline(void* sender, Message const & message) {
+            dispatch(anySender, sender, message);
+
+            if (bySender.empty()) return;
+            auto it = bySender.find(sender);
+            if (it != bySender.end()) dispatch(it->second, sender, message);
+         }
+
+         void publishParallel(void* sender, Message const & message) {
+            if (!workerPool) {
+               dispatchInline(sender, message);
+               dispatch(parallelJoin, sender, message);
+               dispatch(parallelDetached, sender, message);
+               return;
+            }
+
+            if (!parallelDetached.subscribers.empty()) {
+               // detached subscribers may outlive the message and the subscription
+               auto copy = std::make_shared<Message>(message);
+               for (auto & sub : parallelDetached.subscribers) {
+                  if (HandleTable::npos == sub.handle) continue;
+                  auto callback = sub.callback;
+                  workerPool->submit([callback, sender, copy]() { callback(sender, *copy); });
+               }
+            }
+
+            TaskGroup group(*workerPool);
+            for (auto & sub : parallelJoin.subscribers) {
+               if (HandleTable::npos == sub.handle) continue;
+               // copied, as inline subscribers may unsubscribe while this runs
+               auto callback = sub.callback;
+               group.run([callback, sender, &message]() { callback(sender, message); });
+            }
+
+            dispatchInline(sender, message);
+            group.wait();
+         }
+
+         void dispatch(SubscriberList & list, void* sender, Message const & message) {
+            // the list doesn't change size during dispatch, see PublishScope
+            auto & subscribers = list.subscribers;
+            auto count = subscribers.size();
+#if PCX_MESSAGE_BUS_METRICS
+            if (metrics.timeSubscribers) {
+               for (std::size_t i = 0; i < count; ++i) {
+                  if (HandleTable::npos == subscribers[i].handle) continue;
+                  auto start = std::chrono::steady_clock::now();
+                  subscribers[i].callback(sender, message);
+                  metrics.subscriberLatency[subscribers[i].handle].record(std::chrono::steady_clock::now() - start);
+               }
+               return;
+            }
+#endif
+            for (std::size_t i = 0; i < count; ++i) {
+               if (HandleTable::npos != subscribers[i].handle) subscribers[i].callback(sender, message);
+            }
+         }
+
+         Subscription add(CallbackT callback) {
+            return add(anySender, std::move(callback));
+         }
+
+         Subscription add(void* sender, CallbackT callback) {
+            auto & list = bySender[sender];
+            list.sender = sender;
+            list.indexed = true;
+            return add(list, std::move(callback));
+         }
+
+         SubscriberList & listFor(DispatchPolicy policy) {
+            switch (policy) {
+            case DispatchPolicy::ParallelJoin: return parallelJoin;
+            case DispatchPolicy::ParallelDetached: return parallelDetached;
+            default: return anySender;
+            }
+         }
+
+         std::vector<PendingAdd<SubscriberList>> & pendingAddsFor(SubscriberList &) { return pendingAdds; }
+         std::vector<PendingAdd<BatchSubscriberList>> & pendingAddsFor(BatchSubscriberList &) { return pendingBatchAdds; }
+
+         void markDirty(SubscriberList & list) { dirtyLists.push_back(&list); }
+         void markDirty(BatchSubscriberList &) { batchDirty = true; }
+
+         template <typename List>
+         Subscription add(List & list, typename List::CallbackType callback) {
+            typedef typename List::Subscriber Subscriber;
+
+            std::uint32_t handle;
+            if (dispatchDepth > 0) {
+               handle = handles.acquire(nullptr, HandleTable::npos);
+               pendingAddsFor(list).push_back(PendingAdd<List>{ &list, Subscriber{ std::move(callback), handle }, handles.slots[handle].generation });
+               // so that a sender's list is erased if the add is cancelled before it is applied
+               markDirty(list);
+               changesPending = true;
+            }
+            else {
+               handle = handles.acquire(&list, static_cast<std::uint32_t>(list.subscribers.size()));
+               list.subscribers.push_back(Subscriber{ std::move(callback), handle });
+            }
+#if PCX_MESSAGE_BUS_METRICS
+            if (metrics.timeSubscribers) {
+               metrics.subscriberLatency.resize(handles.slots.size());
+               metrics.subscriberLatency[handle].reset();
+            }
+#endif
+            return Subscription(*this, handle, handles.slots[handle].generation);
+         }
+
+         virtual void unsubscribe(std::uint32_t index, std::uint32_t generation) {
+            if (!handles.valid(index, generation)) return;
+
+            // a pending add is dropped when its generation no longer matches
+            auto * list = handles.slots[index].list;
+            if (!list) {
+               handles.release(index);
+               return;
+            }
+
+            if (list == &batch) remove(batch, index);
+            else remove(*static_cast<SubscriberList*>(list), index);
+         }
+
+         template <typename List>
+         void remove(List & list, std::uint32_t index) {
+            auto & subscribers = list.subscribers;
+            auto position = handles.slots[index].position;
+
+            if (dispatchDepth > 0) {
+               subscribers[position].handle = HandleTable::npos;
+               handles.release(index);
+               markDirty(list);
+               changesPending = true;
+               return;
+            }
+
+            if (position + 1 != subscribers.size()) {
+               subscribers[position] = std::move(subscribers.back());
+               handles.slots[subscribers[position].handle].position = position;
+            }
+            subscribers.pop_back();
+            handles.release(index);
+
+            if (subscribers.empty() && list.indexed) bySender.erase(list.sender);
+         }
+
+         void applyPendingChanges() {
+            changesPending = false;
+
+            std::sort(dirtyLists.begin(), dirtyLists.end());
+            dirtyLists.erase(std::unique(dirtyLists.begin(), dirtyLists.end()), dirtyLists.end());
+            for (auto * list : dirtyLists) compact(*list);
+            if (batchDirty) compact(batch);
+            batchDirty = false;
+
+            applyAdds(pendingAdds);
+            applyAdds(pendingBatchAdds);
+
+            for (auto * list : dirtyLists) {
+               if (list->subscribers.empty() && list->indexed) bySender.erase(list->sender);
+            }
+            dirtyLists.clear();
+         }
+
+         // removes subscribers marked during dispatch, keeping the rest in order
+         template <typename List>
+         void compact(List & list) {
+            auto & subscribers = list.subscribers;
+            std::size_t kept = 0;
+            for (std::size_t i = 0; i < subscribers.size(); ++i) {
+               if (HandleTable::npos == subscribers[i].handle) continue;
+               if (kept != i) {
+                  subscribers[kept] = std::move(subscribers[i]);
+                  handles.slots[subscribers[kept].handle].position = static_cast<std::uint32_t>(kept);
+               }
+               ++kept;
+            }
+            subscribers.erase(subscribers.begin() + kept, subscribers.end());
+         }
+
+         template <typename List>
+         void applyAdds(std::vector<PendingAdd<List>> & adds) {
+            for (auto & add : adds) {
+               auto handle = add.subscriber.handle;
+               if (!handles.valid(handle, add.generation)) continue;
+
+               auto & subscribers = add.list->subscribers;
+               handles.slots[handle].list = add.list;
+               handles.slots[handle].position = static_cast<std::uint32_t>(subscribers.size());
+               subscribers.push_back(std::move(add.subscriber));
+            }
+            adds.clear();
+         }
+
+#if PCX_MESSAGE_BUS_METRICS
+         virtual std::size_t handleCount() const { return handles.slots.size(); }
+
+         virtual void snapshot(MessageTypeMetrics & result) const {
+            result.name = demangle_name(typeid(Message).name());
+            result.publishCount = metrics.publishCount;
+            result.totalDispatchTime = metrics.totalDispatchTime;
+            result.maxDispatchTime = metrics.maxDispatchTime;
+
+            // subscribers unsubscribed during a dispatch stay in their lists until it ends
+            result.subscriberCount = liveCount(anySender) + liveCount(batch)
+               + liveCount(parallelJoin) + liveCount(parallelDetached);
+            for (auto & entry : bySender) result.subscriberCount += liveCount(entry.second);
+
+            if (!metrics.timeSubscribers) return;
+
+            auto addSubscribers = [&](SubscriberList const & list) {
+               for (auto & sub : list.subscribers) {
+                  if (HandleTable::npos == sub.handle) continue;
+                  result.subscribers.push_back(SubscriberMetrics{ sub.handle, metrics.subscriberLatency[sub.handle] });
+               }
+            };
+            addSubscribers(anySender);
+            for (auto & entry : bySender) addSubscribers(entry.second);
+         }
+
+         template <typename List>
+         static std::size_t liveCount(List const & list) {
+            std::size_t count = 0;
+            for (auto & sub : list.subscribers) {
+               if (HandleTable::npos != sub.handle) ++count;
+            }
+            return count;
+         }
+#endif
+
+         virtual void takePending() {
+            // a type that became bounded while queued is taken once, through either list
+            if (taken) return;
+            taken = true;
+
+            drainingSenders.clear();
+            drainingMessages.clear();
+            drainingOldest = 0;
+
+            if (bounds) {
+               std::lock_guard<std::mutex> lock(bounds->mutex);
+               bounds->dispatchThread = std::this_thread::get_id();
+               swapPending();
+               std::swap(drainingOldest, bounds->oldest);
+               bounds->space.notify_all();
+            }
+            else {
+               swapPending();
+            }
+         }
+
+         virtual std::size_t dispatchPending() {
+            if (!taken) return 0;
+            taken = false;
+
+            // a DropOldest queue that overflowed starts part way through
+            auto count = drainingMessages.size();
+            publishRuns(drainingOldest, count);
+            publishRuns(0, drainingOldest);
+            return count;
+         }
+
+         // consecutive messages from the same sender are published as one batch
+         void publishRuns(std::size_t begin, std::size_t end) {
+            while (begin < end) {
+               auto runEnd = begin + 1;
+               while (runEnd < end && drainingSenders[runEnd] == drainingSenders[begin]) ++runEnd;
+               publishBatch(drainingSenders[begin], Span<Message const>(&drainingMessages[begin], runEnd - begin));
+               begin = runEnd;
+            }
+         }
+
+         void swapPending() {
+            std::swap(drainingSenders, pendingSenders);
+            std::swap(drainingMessages, pendingMessages);
+            pendingIndex.clear();
          }
       };
 
-      std::unordered_map<std::type_index, void*> publishers_;
+      template <typename Message>
+      Publisher<Message>& findOrCreatePublisher() {
+         auto slot = impl::MessageTypeSlot<Message>::value();
+         if (slot >= publishers_.size()) publishers_.resize(slot + 1);
+
+         auto & publisher = publishers_[slot];
+         if (!publisher) {
+            publisher.reset(new Publisher<Message>{});
+            publisher->workerPool = workerPool_;
+            publisher->ready = &ready_;
+         }
+         return static_cast<Publisher<Message>&>(*publisher);
+      }
+
+      void resumeReady() {
+         // coroutines that wait again are resumed next time
+         impl::WaiterList resuming;
+         resuming.splice(ready_);
+         try {
+            while (auto * waiter = resuming.pop_front()) waiter->resume(waiter->coroutine);
+         }
+         catch (...) {
+            resuming.splice(ready_);
+            ready_.splice(resuming);
+            throw;
+         }
+      }
+
+      template <typename Message>
+      EnqueueResult enqueueTo(Publisher<Message> & publisher, void* sender, Message message) {
+         // bounded publishers are always drained, so aren't added to queued_
+         if (publisher.bounds) return publisher.enqueueBounded(sender, std::move(message));
+
+         if (publisher.pendingMessages.empty()) queued_.push_back(&publisher);
+         publisher.enqueue(sender, std::move(message));
+         return EnqueueResult::Queued;
+      }
+
+      // indexed by impl::MessageTypeSlot, which is process-wide, so there may be
+      // gaps for types this bus has never seen
+      std::vector<std::unique_ptr<PublisherBase>> publishers_;
+      WorkerPool * workerPool_;
+
+      // publishers with pending messages, in the order they were first enqueued to
+      std::vector<PublisherBase*> queued_;
+      std::vector<PublisherBase*> draining_;
+      std::vector<PublisherBase*> bounded_;
+      impl::WaiterList ready_;
+      bool dispatching_;
+
+      TimerWheel timers_;
    };
 
 } // namespace pcx
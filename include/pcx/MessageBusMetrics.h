@@ -0,0 +1,126 @@
+#ifndef PCX_MESSAGE_BUS_METRICS_H
+#define PCX_MESSAGE_BUS_METRICS_H
+
+#include <chrono>
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+// MessageBus dispatch metrics are compiled in only when this is non-zero (see the
+// PCX_MESSAGE_BUS_METRICS cmake option). It must be the same for every translation
+// unit in a program.
+#ifndef PCX_MESSAGE_BUS_METRICS
+#define PCX_MESSAGE_BUS_METRICS 0
+#endif
+
+namespace pcx
+{
+   class MessageBus;
+
+   /**
+    * @brief Log2 bucketed latency histogram: bucket i counts durations in the
+    * range [2^i, 2^(i+1)) ns
+    */
+   struct LatencyHistogram
+   {
+      static const std::size_t bucketCount = 40;
+
+      LatencyHistogram() { reset(); }
+
+      void reset();
+      void record(std::chrono::nanoseconds duration);
+
+      std::uint64_t count() const;
+
+      /// Upper bound of the bucket holding the given percentile (0-100)
+      std::chrono::nanoseconds percentile(double p) const;
+
+      std::uint64_t buckets[bucketCount];
+   };
+
+   struct SubscriberMetrics
+   {
+      std::uint32_t handle;          // identifies the subscription within its message type
+      LatencyHistogram latency;
+   };
+
+   struct MessageTypeMetrics
+   {
+      MessageTypeMetrics() : publishCount(0), subscriberCount(0), totalDispatchTime(0), maxDispatchTime(0) { }
+
+      std::string name;
+      std::uint64_t publishCount;                  // each message of a batch counts
+      std::size_t subscriberCount;
+      std::chrono::nanoseconds totalDispatchTime;
+      std::chrono::nanoseconds maxDispatchTime;    // of a single publish or batch
+
+      // only populated for inline subscribers while subscriber timing is enabled
+      std::vector<SubscriberMetrics> subscribers;
+   };
+
+   /// Writes a table of metrics, most expensive message types first
+   void writeMetrics(std::ostream & out, std::vector<MessageTypeMetrics> metrics);
+
+   /**
+    * @brief The MessageBusMetricsLog class periodically appends a bus' metrics to a
+    * file. Drive it from the frame loop (e.g. a Module::update).
+    */
+   class MessageBusMetricsLog
+   {
+   public:
+      MessageBusMetricsLog(MessageBus const & bus, std::string filename, double intervalSeconds);
+
+      void update(double timeSinceLast);
+      void write();
+
+   private:
+      MessageBus const & bus_;
+      std::string filename_;
+      double interval_;
+      double sinceLastWrite_;
+   };
+
+   namespace impl
+   {
+      /// Per message type counters kept by a MessageBus publisher
+      struct DispatchMetrics
+      {
+         DispatchMetrics() : publishCount(0), totalDispatchTime(0), maxDispatchTime(0), timeSubscribers(false) { }
+
+         std::uint64_t publishCount;
+         std::chrono::nanoseconds totalDispatchTime;
+         std::chrono::nanoseconds maxDispatchTime;
+
+         bool timeSubscribers;
+         std::vector<LatencyHistogram> subscriberLatency;    // indexed by subscription handle
+
+         void record(std::chrono::nanoseconds duration, std::uint64_t count)
+         {
+            publishCount += count;
+            totalDispatchTime += duration;
+            if (duration > maxDispatchTime) maxDispatchTime = duration;
+         }
+      };
+
+      class DispatchTimer
+      {
+      public:
+         DispatchTimer(DispatchMetrics & metrics, std::uint64_t count)
+            : metrics_(metrics), count_(count), start_(std::chrono::steady_clock::now()) { }
+
+         ~DispatchTimer()
+         {
+            metrics_.record(std::chrono::steady_clock::now() - start_, count_);
+         }
+
+      private:
+         DispatchMetrics & metrics_;
+         std::uint64_t count_;
+         std::chrono::steady_clock::time_point start_;
+      };
+   } // namespace impl
+
+} // namespace pcx
+
+#endif // #ifndef PCX_MESSAGE_BUS_METRICS_H
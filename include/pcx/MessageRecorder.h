@@ -0,0 +1,161 @@
+#ifndef PCX_MESSAGE_RECORDER_H
+#define PCX_MESSAGE_RECORDER_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <pcx/MessageBus.h>
+#include <pcx/impl/MessageTypeSlot.h>
+
+namespace pcx
+{
+   namespace impl
+   {
+      class MappedLogFile;
+   } // namespace impl
+
+   /**
+    * @brief The MessageRecorder class taps message types on a MessageBus and appends
+    * every message dispatched to them to a memory-mapped log file, with a timestamp
+    * relative to the start of the recording and the sender's address.
+    * Trivially copyable messages are stored as-is; other types need a serialiser
+    * (and a matching deserialiser in MessageReplayer).
+    * Like any subscriber, a recorder must not outlive the buses it records.
+    */
+   class MessageRecorder
+   {
+   public:
+      typedef std::vector<char> BufferT;
+
+      explicit MessageRecorder(std::string const & filename);
+      ~MessageRecorder();
+
+      template <typename Message>
+      void record(MessageBus & bus);
+
+      template <typename Message>
+      void record(MessageBus & bus, std::function<void(Message const &, BufferT &)> serialise);
+
+      /// Stops recording and flushes the log to disk
+      void stop();
+
+      std::size_t recordCount() const { return recordCount_; }
+
+   private:
+      MessageRecorder(MessageRecorder const &);
+      MessageRecorder & operator=(MessageRecorder const &);
+
+      void append(std::uint64_t typeId, void* sender, void const * data, std::size_t size);
+
+      std::unique_ptr<impl::MappedLogFile> log_;
+      std::chrono::steady_clock::time_point start_;
+      std::vector<Subscription> subscriptions_;
+      BufferT buffer_;
+      std::size_t recordCount_;
+   };
+
+   /**
+    * @brief The MessageReplayer class re-publishes a MessageRecorder log into a bus,
+    * either as fast as possible or with the original timing.
+    * Only message types registered with add() are replayed, others are skipped.
+    * Senders are replayed as the addresses they had when recorded: they keep their
+    * identity but must not be dereferenced.
+    */
+   class MessageReplayer
+   {
+   public:
+      enum class Pacing { AsFastAsPossible, OriginalTime };
+
+      explicit MessageReplayer(std::string const & filename);
+      ~MessageReplayer();
+
+      template <typename Message>
+      void add();
+
+      template <typename Message>
+      void add(std::function<Message(char const * data, std::size_t size)> deserialise);
+
+      /// @return the number of messages published
+      std::size_t replay(MessageBus & bus, Pacing pacing = Pacing::AsFastAsPossible);
+
+      std::size_t skippedCount() const { return skippedCount_; }
+
+   private:
+      MessageReplayer(MessageReplayer const &);
+      MessageReplayer & operator=(MessageReplayer const &);
+
+      typedef std::function<void(MessageBus &, void*, char const *, std::size_t)> PublisherT;
+
+      std::unique_ptr<impl::MappedLogFile> log_;
+      std::unordered_map<std::uint64_t, PublisherT> publishers_;
+      std::size_t skippedCount_;
+   };
+
+   //
+   // MessageRecorder Implementation
+   //
+
+   template <typename Message>
+   void MessageRecorder::record(MessageBus & bus)
+   {
+      static_assert(std::is_trivially_copyable<Message>::value, "messages that are not trivially copyable need a serialiser");
+
+      auto typeId = impl::messageTypeId<Message>();
+      subscriptions_.push_back(bus.subscribe<Message>([this, typeId](void* sender, Message const & message)
+      {
+         append(typeId, sender, &message, sizeof(Message));
+      }));
+   }
+
+   template <typename Message>
+   void MessageRecorder::record(MessageBus & bus, std::function<void(Message const &, BufferT &)> serialise)
+   {
+      auto typeId = impl::messageTypeId<Message>();
+      subscriptions_.push_back(bus.subscribe<Message>([this, typeId, serialise](void* sender, Message const & message)
+      {
+         buffer_.clear();
+         serialise(message, buffer_);
+         append(typeId, sender, buffer_.data(), buffer_.size());
+      }));
+   }
+
+   //
+   // MessageReplayer Implementation
+   //
+
+   template <typename Message>
+   void MessageReplayer::add()
+   {
+      static_assert(std::is_trivially_copyable<Message>::value, "messages that are not trivially copyable need a deserialiser");
+
+      publishers_[impl::messageTypeId<Message>()] = [](MessageBus & bus, void* sender, char const * data, std::size_t size)
+      {
+         if (size != sizeof(Message)) throw std::runtime_error("recorded message size mismatch");
+
+         // the log only guarantees 8 byte alignment
+         typename std::aligned_storage<sizeof(Message), alignof(Message)>::type storage;
+         std::memcpy(&storage, data, sizeof(Message));
+         bus.publish(sender, *reinterpret_cast<Message const *>(&storage));
+      };
+   }
+
+   template <typename Message>
+   void MessageReplayer::add(std::function<Message(char const * data, std::size_t size)> deserialise)
+   {
+      publishers_[impl::messageTypeId<Message>()] = [deserialise](MessageBus & bus, void* sender, char const * data, std::size_t size)
+      {
+         bus.publish(sender, deserialise(data, size));
+      };
+   }
+
+} // namespace pcx
+
+#endif // #ifndef PCX_MESSAGE_RECORDER_H
@@ -0,0 +1,72 @@
+#ifndef PCX_ROUTINE_H
+#define PCX_ROUTINE_H
+
+// The rest of pcx is C++11; only code that includes this header needs C++20
+#if !defined(__cpp_impl_coroutine)
+#error "pcx/Routine.h needs a compiler with C++20 coroutines enabled"
+#endif
+
+#include <coroutine>
+#include <exception>
+#include <utility>
+
+namespace pcx
+{
+   /**
+    * @brief The Routine class is a coroutine for logic that waits on events, such as
+    * co_await bus.next<Message>(). It starts running as soon as it is called, and
+    * is destroyed (cancelling anything it is waiting on) with its Routine object.
+    * An exception thrown by the coroutine ends it and is kept in error().
+    */
+   class Routine
+   {
+   public:
+      struct promise_type
+      {
+         Routine get_return_object() { return Routine(std::coroutine_handle<promise_type>::from_promise(*this)); }
+         std::suspend_never initial_suspend() noexcept { return {}; }
+         std::suspend_always final_suspend() noexcept { return {}; }
+         void return_void() { }
+         void unhandled_exception() { error = std::current_exception(); }
+
+         std::exception_ptr error;
+      };
+
+      Routine() { }
+      Routine(Routine && other) : handle_(std::exchange(other.handle_, nullptr)) { }
+
+      Routine & operator=(Routine && other)
+      {
+         if (this != &other)
+         {
+            reset();
+            handle_ = std::exchange(other.handle_, nullptr);
+         }
+         return *this;
+      }
+
+      ~Routine() { reset(); }
+
+      /// Destroys the coroutine, wherever it is suspended
+      void reset()
+      {
+         if (handle_) handle_.destroy();
+         handle_ = nullptr;
+      }
+
+      bool done() const { return !handle_ || handle_.done(); }
+
+      std::exception_ptr error() const { return handle_ ? handle_.promise().error : nullptr; }
+
+   private:
+      Routine(Routine const &);
+      Routine & operator=(Routine const &);
+
+      explicit Routine(std::coroutine_handle<promise_type> handle) : handle_(handle) { }
+
+      std::coroutine_handle<promise_type> handle_;
+   };
+
+} // namespace pcx
+
+#endif // #ifndef PCX_ROUTINE_H
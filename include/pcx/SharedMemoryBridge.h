@@ -0,0 +1,154 @@
+#ifndef PCX_SHARED_MEMORY_BRIDGE_H
+#define PCX_SHARED_MEMORY_BRIDGE_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <unordered_map>
+#include <vector>
+
+#include <pcx/MessageBus.h>
+#include <pcx/impl/MessageTypeSlot.h>
+
+namespace pcx
+{
+   namespace impl
+   {
+      class SharedRing;
+   } // namespace impl
+
+   /**
+    * @brief The MessageBusImporter class owns a named shared memory ring that other
+    * processes on the same machine write messages into (see MessageBusExporter), and
+    * publishes the messages it reads from it into a local bus.
+    * The ring holds a fixed number of fixed-size slots, so only trivially copyable
+    * messages up to maxMessageSize bytes can be bridged. Messages are copied into the
+    * ring and straight back out, without serialisation.
+    * Senders are passed on as the addresses they had in the exporting process: they
+    * keep their identity but must not be dereferenced.
+    * The ring is removed when the importer is destroyed.
+    */
+   class MessageBusImporter
+   {
+   public:
+      MessageBusImporter(std::string const & name, std::size_t slotCount = 1024, std::size_t maxMessageSize = 224);
+      ~MessageBusImporter();
+
+      /// Imports Message; messages of types that were not added are skipped
+      template <typename Message>
+      void add();
+
+      /**
+       * Publishes the messages waiting in the ring to bus
+       * @return the number of messages published
+       */
+      std::size_t poll(MessageBus & bus);
+
+      /**
+       * Sleeps until there are messages waiting or the timeout passes
+       * @return whether there are messages waiting
+       */
+      bool wait(std::chrono::milliseconds timeout);
+
+      std::size_t skippedCount() const { return skippedCount_; }
+
+   private:
+      MessageBusImporter(MessageBusImporter const &);
+      MessageBusImporter & operator=(MessageBusImporter const &);
+
+      typedef std::function<void(MessageBus &, void*, char const *)> PublisherT;
+
+      std::unique_ptr<impl::SharedRing> ring_;
+      std::unordered_map<std::uint64_t, std::pair<std::size_t, PublisherT>> publishers_;
+      std::size_t skippedCount_;
+   };
+
+   /**
+    * @brief The MessageBusExporter class opens the shared memory ring of a
+    * MessageBusImporter (usually in another process) and writes messages into it.
+    * Any number of exporters, in any number of processes, may write to one ring.
+    * Writing never blocks: messages that don't fit in a full ring are dropped and
+    * counted.
+    * Like any subscriber, an exporter must not outlive the buses it forwards.
+    */
+   class MessageBusExporter
+   {
+   public:
+      explicit MessageBusExporter(std::string const & name);
+      ~MessageBusExporter();
+
+      /// Forwards every Message published on bus
+      template <typename Message>
+      void forward(MessageBus & bus);
+
+      /// @return false if the ring was full and the message was dropped
+      template <typename Message>
+      bool send(void* sender, Message const & message);
+
+      std::uint64_t droppedCount() const { return droppedCount_; }
+
+   private:
+      MessageBusExporter(MessageBusExporter const &);
+      MessageBusExporter & operator=(MessageBusExporter const &);
+
+      void checkSize(std::size_t size) const;
+      bool write(std::uint64_t typeId, void* sender, void const * data, std::size_t size);
+
+      std::unique_ptr<impl::SharedRing> ring_;
+      std::vector<Subscription> subscriptions_;
+      std::uint64_t droppedCount_;
+   };
+
+   //
+   // MessageBusImporter Implementation
+   //
+
+   template <typename Message>
+   void MessageBusImporter::add()
+   {
+      static_assert(std::is_trivially_copyable<Message>::value, "only trivially copyable messages can be shared");
+
+      publishers_[impl::messageTypeId<Message>()] = std::make_pair(sizeof(Message),
+         [](MessageBus & bus, void* sender, char const * data)
+         {
+            // slots only guarantee 8 byte alignment
+            typename std::aligned_storage<sizeof(Message), alignof(Message)>::type storage;
+            std::memcpy(&storage, data, sizeof(Message));
+            bus.publish(sender, *reinterpret_cast<Message const *>(&storage));
+         });
+   }
+
+   //
+   // MessageBusExporter Implementation
+   //
+
+   template <typename Message>
+   void MessageBusExporter::forward(MessageBus & bus)
+   {
+      static_assert(std::is_trivially_copyable<Message>::value, "only trivially copyable messages can be shared");
+      checkSize(sizeof(Message));
+
+      auto typeId = impl::messageTypeId<Message>();
+      subscriptions_.push_back(bus.subscribe<Message>([this, typeId](void* sender, Message const & message)
+      {
+         write(typeId, sender, &message, sizeof(Message));
+      }));
+   }
+
+   template <typename Message>
+   bool MessageBusExporter::send(void* sender, Message const & message)
+   {
+      static_assert(std::is_trivially_copyable<Message>::value, "only trivially copyable messages can be shared");
+      checkSize(sizeof(Message));
+
+      return write(impl::messageTypeId<Message>(), sender, &message, sizeof(Message));
+   }
+
+} // namespace pcx
+
+#endif // #ifndef PCX_SHARED_MEMORY_BRIDGE_H
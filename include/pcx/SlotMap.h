@@ -0,0 +1,229 @@
+#ifndef PCX_SLOT_MAP_H
+#define PCX_SLOT_MAP_H
+
+#include <cstdint>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include <pcx/IndexPool.h>
+
+namespace pcx
+{
+   /**
+    * @brief The SlotMap class stores values of T densely, in one contiguous array,
+    * and hands out handles that stay valid until their value is erased.
+    * A handle is an IndexPool index plus the generation of that index, which is
+    * bumped each time a value is erased; a handle whose generation no longer
+    * matches is stale and is rejected rather than aliasing whatever value now
+    * occupies its index. Handles are checked in O(1).
+    * Erasing moves the last value into the gap, so values (and pointers to them)
+    * do not keep their position, and iteration is in no particular order.
+    */
+   template <typename T>
+   class SlotMap
+   {
+   public:
+      struct Handle
+      {
+         Handle() : index(~std::uint32_t(0)), generation(0) { }
+         Handle(std::uint32_t index, std::uint32_t generation) : index(index), generation(generation) { }
+
+         bool operator==(Handle const & other) const { return index == other.index && generation == other.generation; }
+         bool operator!=(Handle const & other) const { return !(*this == other); }
+
+         std::uint32_t index;
+         std::uint32_t generation;
+      };
+
+      explicit SlotMap(long capacity);
+
+      /// Throws if the map is full
+      Handle Insert(T value);
+
+      template <typename... Args>
+      Handle Emplace(Args &&... args);
+
+      /// @return false if the handle was stale
+      bool Erase(Handle handle);
+
+      bool Contains(Handle handle) const;
+
+      /// @return the value, or nullptr if the handle is stale
+      T * Find(Handle handle);
+      T const * Find(Handle handle) const;
+
+      /// Throws if the handle is stale
+      T & Get(Handle handle);
+      T const & Get(Handle handle) const;
+
+      long Size() const { return static_cast<long>(values_.size()); }
+      long Capacity() const { return pool_.Reserved(); }
+
+      /// The values, densely packed
+      T * Data() { return values_.data(); }
+      T const * Data() const { return values_.data(); }
+
+      /// The handle of the value at a position in Data()
+      Handle HandleAt(long position) const;
+
+      /// Calls f(Handle, T &) for each value
+      template <typename F>
+      void ForEach(F f)
+      {
+         for (std::size_t i = 0; i < values_.size(); ++i)
+         {
+            auto index = indices_[i];
+            f(Handle(index, slots_[index].generation), values_[i]);
+         }
+      }
+
+   private:
+      SlotMap(SlotMap const &);
+      SlotMap & operator=(SlotMap const &);
+
+      static const std::uint32_t npos = ~std::uint32_t(0);
+
+      struct Slot
+      {
+         std::uint32_t position;    // in values_, npos while free
+         std::uint32_t generation;
+      };
+
+      Handle Add(long index);
+      long PositionOf(Handle handle) const;
+
+      IndexPool pool_;
+      std::vector<Slot> slots_;                 // indexed by pool index
+      std::vector<T> values_;
+      std::vector<std::uint32_t> indices_;      // the pool index of each value
+   };
+
+   //
+   // SlotMap Implementation
+   //
+
+   template <typename T>
+   const std::uint32_t SlotMap<T>::npos;
+
+   template <typename T>
+   SlotMap<T>::SlotMap(long capacity)
+      : pool_(capacity), slots_(capacity, Slot{ npos, 0 })
+   {
+      // values never reallocate, so pointers to them stay valid until an erase
+      values_.reserve(capacity);
+      indices_.reserve(capacity);
+   }
+
+   template <typename T>
+   typename SlotMap<T>::Handle SlotMap<T>::Insert(T value)
+   {
+      return Emplace(std::move(value));
+   }
+
+   template <typename T>
+   template <typename... Args>
+   typename SlotMap<T>::Handle SlotMap<T>::Emplace(Args &&... args)
+   {
+      auto index = pool_.Allocate();
+      try
+      {
+         values_.emplace_back(std::forward<Args>(args)...);
+      }
+      catch (...)
+      {
+         pool_.Free(index);
+         throw;
+      }
+      return Add(index);
+   }
+
+   template <typename T>
+   typename SlotMap<T>::Handle SlotMap<T>::Add(long index)
+   {
+      auto & slot = slots_[index];
+      slot.position = static_cast<std::uint32_t>(indices_.size());
+      indices_.push_back(static_cast<std::uint32_t>(index));
+      return Handle(static_cast<std::uint32_t>(index), slot.generation);
+   }
+
+   template <typename T>
+   bool SlotMap<T>::Erase(Handle handle)
+   {
+      auto position = PositionOf(handle);
+      if (-1 == position) return false;
+
+      // fill the gap with the last value
+      auto last = static_cast<long>(values_.size()) - 1;
+      if (position != last)
+      {
+         values_[position] = std::move(values_[last]);
+         indices_[position] = indices_[last];
+         slots_[indices_[position]].position = static_cast<std::uint32_t>(position);
+      }
+      values_.pop_back();
+      indices_.pop_back();
+
+      auto & slot = slots_[handle.index];
+      slot.position = npos;
+      ++slot.generation;
+      pool_.Free(handle.index);
+      return true;
+   }
+
+   template <typename T>
+   bool SlotMap<T>::Contains(Handle handle) const
+   {
+      return -1 != PositionOf(handle);
+   }
+
+   template <typename T>
+   T * SlotMap<T>::Find(Handle handle)
+   {
+      auto position = PositionOf(handle);
+      return -1 == position ? nullptr : &values_[position];
+   }
+
+   template <typename T>
+   T const * SlotMap<T>::Find(Handle handle) const
+   {
+      auto position = PositionOf(handle);
+      return -1 == position ? nullptr : &values_[position];
+   }
+
+   template <typename T>
+   T & SlotMap<T>::Get(Handle handle)
+   {
+      auto * value = Find(handle);
+      if (!value) throw std::runtime_error("Stale SlotMap handle");
+      return *value;
+   }
+
+   template <typename T>
+   T const & SlotMap<T>::Get(Handle handle) const
+   {
+      auto * value = Find(handle);
+      if (!value) throw std::runtime_error("Stale SlotMap handle");
+      return *value;
+   }
+
+   template <typename T>
+   typename SlotMap<T>::Handle SlotMap<T>::HandleAt(long position) const
+   {
+      auto index = indices_.at(position);
+      return Handle(index, slots_[index].generation);
+   }
+
+   template <typename T>
+   long SlotMap<T>::PositionOf(Handle handle) const
+   {
+      if (handle.index >= slots_.size()) return -1;
+
+      auto & slot = slots_[handle.index];
+      if (npos == slot.position || slot.generation != handle.generation) return -1;
+      return slot.position;
+   }
+
+} // namespace pcx
+
+#endif // #ifndef PCX_SLOT_MAP_H
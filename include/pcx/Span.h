@@ -0,0 +1,50 @@
+#ifndef PCX_SPAN_H
+#define PCX_SPAN_H
+
+#include <cstddef>
+#include <type_traits>
+#include <utility>
+
+namespace pcx
+{
+   /**
+    * @brief A non-owning view of a contiguous array, like C++20's std::span.
+    * Converts implicitly from arrays and from containers with data() and size(),
+    * such as std::vector, so functions can take a Span<T const> of any of them.
+    */
+   template <typename T>
+   class Span
+   {
+   public:
+      typedef T value_type;
+      typedef T * iterator;
+
+      Span() : data_(nullptr), size_(0) { }
+      Span(T * data, std::size_t size) : data_(data), size_(size) { }
+
+      template <std::size_t N>
+      Span(T (&array)[N]) : data_(array), size_(N) { }
+
+      template <typename Container, typename = typename std::enable_if<
+         std::is_convertible<decltype(std::declval<Container&>().data()), T*>::value>::type>
+      Span(Container & container) : data_(container.data()), size_(container.size()) { }
+
+      T * data() const { return data_; }
+      std::size_t size() const { return size_; }
+      bool empty() const { return 0 == size_; }
+
+      T * begin() const { return data_; }
+      T * end() const { return data_ + size_; }
+
+      T & operator[](std::size_t index) const { return data_[index]; }
+
+      Span subspan(std::size_t offset, std::size_t count) const { return Span(data_ + offset, count); }
+
+   private:
+      T * data_;
+      std::size_t size_;
+   };
+
+} // namespace pcx
+
+#endif // #ifndef PCX_SPAN_H
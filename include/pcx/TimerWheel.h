@@ -0,0 +1,120 @@
+#ifndef PCX_TIMER_WHEEL_H
+#define PCX_TIMER_WHEEL_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+#include <pcx/impl/InplaceFunction.h>
+
+namespace pcx
+{
+   /**
+    * @brief Identifies a timer scheduled on a TimerWheel. Ids of timers that have
+    * fired (or been cancelled) are never mistaken for later timers.
+    */
+   struct TimerId
+   {
+      TimerId() : index(~std::uint32_t(0)), generation(0) { }
+      TimerId(std::uint32_t index, std::uint32_t generation) : index(index), generation(generation) { }
+
+      std::uint32_t index;
+      std::uint32_t generation;
+   };
+
+   /**
+    * @brief The TimerWheel class runs callbacks after a delay, once or repeatedly,
+    * as time is fed to it by advance() (typically from the frame loop).
+    * Timers are kept in a hierarchy of wheels of 64 slots, each level 64 times
+    * coarser than the one below, and are moved down a level as their time comes
+    * closer, so scheduling and cancelling are O(1) however many timers there are.
+    * Time is counted in whole ticks of the resolution given at construction; a
+    * timer never fires early, and fires on the first advance that reaches its
+    * tick. Timers due on the same tick fire in no particular order.
+    * Callbacks may schedule and cancel timers, including their own.
+    */
+   class TimerWheel
+   {
+   public:
+      typedef std::chrono::nanoseconds Duration;
+      // room for a small message, a sender and a pointer, see MessageBus::publishAfter
+      typedef impl::InplaceFunction<void(), 8 * sizeof(void*)> CallbackT;
+
+      explicit TimerWheel(Duration resolution = std::chrono::milliseconds(1));
+
+      /// Runs callback once, delay from now
+      TimerId schedule(Duration delay, CallbackT callback);
+
+      /// Runs callback delay from now, then every interval after that
+      TimerId scheduleRepeating(Duration delay, Duration interval, CallbackT callback);
+
+      /// @return false if the timer had already fired (or been cancelled)
+      bool cancel(TimerId id);
+
+      bool scheduled(TimerId id) const;
+
+      /// The number of timers scheduled
+      std::size_t size() const { return count_; }
+
+      /**
+       * Moves time forward, running the callbacks of every timer that comes due.
+       * If a callback throws, the exception propagates and the remaining time is
+       * not advanced; timers already due still fire on the next advance.
+       * @return the number of callbacks run
+       */
+      std::size_t advance(Duration elapsed);
+
+      /// The time advanced so far
+      Duration now() const { return resolution_ * static_cast<Duration::rep>(now_) + carry_; }
+
+   private:
+      TimerWheel(TimerWheel const &);
+      TimerWheel & operator=(TimerWheel const &);
+
+      static const unsigned LevelBits = 6;
+      static const unsigned SlotsPerLevel = 1 << LevelBits;
+      static const unsigned Levels = 6;
+      // timers come due from this list, which is kept between advances in case a callback throws
+      static const unsigned DueList = Levels * SlotsPerLevel;
+      static const std::uint32_t npos = ~std::uint32_t(0);
+
+      struct Node
+      {
+         std::uint64_t expiry;      // in ticks
+         std::uint64_t interval;    // in ticks, 0 for one-shot timers
+         std::uint32_t prev;
+         std::uint32_t next;        // next free node while unused
+         std::uint32_t list;        // npos while unused
+         std::uint32_t generation;
+         CallbackT callback;
+      };
+
+      std::uint64_t ticksFrom(Duration delay) const;
+      TimerId add(std::uint64_t delay, std::uint64_t interval, CallbackT callback);
+      void release(std::uint32_t index);
+
+      void insert(std::uint32_t index);
+      void link(std::uint32_t index, std::uint32_t list);
+      void unlink(std::uint32_t index);
+
+      std::uint64_t nextTick(std::uint64_t target) const;
+      void cascade(std::uint64_t tick);
+      std::size_t fireDue();
+
+      Duration resolution_;
+      std::uint64_t now_;
+      Duration carry_;           // time since the current tick, less than resolution_
+      std::size_t count_;
+
+      std::vector<Node> nodes_;
+      std::uint32_t freeNode_;
+
+      std::uint32_t heads_[DueList + 1];
+      std::uint32_t tails_[DueList + 1];
+      std::uint64_t occupied_[Levels];    // a bit per non-empty slot
+   };
+
+} // namespace pcx
+
+#endif // #ifndef PCX_TIMER_WHEEL_H
@@ -4,6 +4,19 @@
 #include <string>
 #include <typeindex>
 
+#if defined(_MSC_VER)
+#include <sal.h>
+#endif
+
+/// Marks a function whose result must not be ignored (the repo is C++11, so no [[nodiscard]])
+#if defined(__GNUC__) || defined(__clang__)
+#define PCX_NODISCARD __attribute__((warn_unused_result))
+#elif defined(_MSC_VER)
+#define PCX_NODISCARD _Check_return_
+#else
+#define PCX_NODISCARD
+#endif
+
 namespace pcx
 {
    /// Returns user-friendly name
@@ -0,0 +1,108 @@
+#ifndef PCX_WORKER_POOL_H
+#define PCX_WORKER_POOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pcx
+{
+   class TaskGroup;
+
+   /**
+    * @brief The WorkerPool class runs tasks on a fixed set of worker threads.
+    * Tasks submitted directly are detached: nobody waits for them and exceptions
+    * they throw are logged and dropped. Use a TaskGroup for fork-join work.
+    * The destructor runs any tasks still queued before joining the workers.
+    * Each worker has its own queue for the tasks it submits, which it runs newest
+    * first; a worker with nothing to do takes tasks submitted from other threads,
+    * then steals the oldest tasks from the other workers' queues.
+    */
+   class WorkerPool
+   {
+   public:
+      explicit WorkerPool(std::size_t threadCount = std::thread::hardware_concurrency());
+      ~WorkerPool();
+
+      std::size_t size() const { return workers_.size(); }
+
+      void submit(std::function<void()> task);
+
+   private:
+      WorkerPool(WorkerPool const &);
+      WorkerPool & operator=(WorkerPool const &);
+
+      friend class TaskGroup;
+
+      struct Task
+      {
+         std::function<void()> func;
+         TaskGroup * group;
+      };
+
+      struct Queue
+      {
+         std::mutex mutex;
+         std::deque<Task> tasks;
+
+         // keep each queue on its own cache lines so workers never share one
+         char padding[64];
+      };
+
+      void push(Task task);
+      bool take(Task & task);
+      bool tryRunOne();
+      void run(Task & task);
+      void workerLoop(std::size_t index);
+
+      std::vector<std::thread> workers_;
+      std::vector<std::unique_ptr<Queue>> queues_;    // one per worker
+
+      std::mutex mutex_;
+      std::condition_variable wake_;
+      std::deque<Task> tasks_;                        // submitted from other threads
+      bool stopping_;
+
+      std::atomic<std::size_t> queued_;               // tasks in all of the queues
+      std::atomic<std::size_t> sleeping_;             // workers waiting on wake_
+   };
+
+   /**
+    * @brief A set of tasks run on a WorkerPool that can be waited on together.
+    * wait() helps run queued tasks while it waits, so it is safe to call from a
+    * worker thread, and rethrows the first exception any of the group's tasks threw.
+    */
+   class TaskGroup
+   {
+   public:
+      explicit TaskGroup(WorkerPool & pool);
+      ~TaskGroup();
+
+      void run(std::function<void()> task);
+      void wait();
+
+   private:
+      TaskGroup(TaskGroup const &);
+      TaskGroup & operator=(TaskGroup const &);
+
+      friend class WorkerPool;
+      void finished(std::exception_ptr error);
+
+      WorkerPool & pool_;
+
+      std::mutex mutex_;
+      std::condition_variable done_;
+      std::size_t pending_;
+      std::exception_ptr error_;
+   };
+
+} // namespace pcx
+
+#endif // #ifndef PCX_WORKER_POOL_H
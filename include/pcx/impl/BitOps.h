@@ -0,0 +1,75 @@
+#ifndef PCX_BIT_OPS_H
+#define PCX_BIT_OPS_H
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PCX_BIT_OPS_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace pcx
+{
+   namespace impl
+   {
+      /// Index of the lowest set bit; bits must not be 0
+      inline unsigned countTrailingZeros(std::uint64_t bits)
+      {
+#if defined(_MSC_VER)
+         unsigned long index;
+         _BitScanForward64(&index, bits);
+         return static_cast<unsigned>(index);
+#else
+         return static_cast<unsigned>(__builtin_ctzll(bits));
+#endif
+      }
+
+      inline unsigned popCount(std::uint64_t bits)
+      {
+#if defined(_MSC_VER)
+         return static_cast<unsigned>(__popcnt64(bits));
+#else
+         return static_cast<unsigned>(__builtin_popcountll(bits));
+#endif
+      }
+
+      /**
+       * Calls f(base + i) for each set bit i of the count words, in ascending order.
+       * Where SSE2 is available, runs of empty words are skipped four at a time.
+       */
+      template <typename F>
+      void forEachSetBit(std::uint64_t const * words, std::size_t count, long base, F & f)
+      {
+         std::size_t i = 0;
+         while (i < count)
+         {
+#if defined(PCX_BIT_OPS_SSE2)
+            if (i + 4 <= count)
+            {
+               auto a = _mm_loadu_si128(reinterpret_cast<__m128i const *>(words + i));
+               auto b = _mm_loadu_si128(reinterpret_cast<__m128i const *>(words + i + 2));
+               auto zero = _mm_cmpeq_epi8(_mm_or_si128(a, b), _mm_setzero_si128());
+               if (0xFFFF == _mm_movemask_epi8(zero))
+               {
+                  i += 4;
+                  continue;
+               }
+            }
+#endif
+            for (auto bits = words[i]; 0 != bits; bits &= bits - 1)
+            {
+               f(base + static_cast<long>(i * 64 + countTrailingZeros(bits)));
+            }
+            ++i;
+         }
+      }
+
+   } // namespace impl
+} // namespace pcx
+
+#endif // #ifndef PCX_BIT_OPS_H
@@ -0,0 +1,121 @@
+#ifndef PCX_COMPONENT_STORE_H
+#define PCX_COMPONENT_STORE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include <pcx/impl/TypeSlot.h>
+
+namespace pcx
+{
+   namespace impl
+   {
+      struct ComponentTypeTag;
+
+      /// Maps each component type to a dense TypeSlot, numbered apart from message types
+      template <typename Component>
+      using ComponentTypeSlot = TypeSlot<ComponentTypeTag, Component>;
+
+      /**
+       * @brief The sparse set behind a ComponentStore. The entity index of each
+       * component is kept densely, in the same order as the components, and a
+       * sparse array indexed by entity index holds each entity's position in the
+       * dense arrays, so membership and lookup are O(1) and removal swaps the last
+       * component into the gap.
+       */
+      class BaseComponentStore
+      {
+      public:
+         static const std::uint32_t npos = ~std::uint32_t(0);
+
+         virtual ~BaseComponentStore() { }
+
+         long size() const { return static_cast<long>(entities_.size()); }
+
+         /// The entity index of each component, densely packed
+         std::uint32_t const * entities() const { return entities_.data(); }
+
+         bool contains(std::uint32_t index) const { return index < sparse_.size() && npos != sparse_[index]; }
+
+         /// Removes the component of an entity that has one
+         virtual void remove(std::uint32_t index) = 0;
+
+      protected:
+         BaseComponentStore() { }
+
+         /// Adds index at the end of the dense array
+         void insertIndex(std::uint32_t index);
+         /// Moves the last index into the position of index, which is then removed
+         void removeIndex(std::uint32_t index);
+
+         std::vector<std::uint32_t> sparse_;       // position in the dense arrays by entity index, npos if absent
+         std::vector<std::uint32_t> entities_;     // entity index at each position
+
+      private:
+         BaseComponentStore(BaseComponentStore const &);
+         BaseComponentStore & operator=(BaseComponentStore const &);
+      };
+
+      /**
+       * @brief The components of one type, in one contiguous array. Components
+       * move when others are removed, so references to them are only good until
+       * the next change to the store.
+       */
+      template <typename Component>
+      class ComponentStore : public BaseComponentStore
+      {
+      public:
+         /// The entity must not already have a component in this store
+         template <typename... Args>
+         Component & emplace(std::uint32_t index, Args &&... args);
+
+         void remove(std::uint32_t index) override;
+
+         /// The component of an entity that has one
+         Component & get(std::uint32_t index) { return components_[sparse_[index]]; }
+         Component const & get(std::uint32_t index) const { return components_[sparse_[index]]; }
+
+         /// The components, densely packed in the order of entities()
+         Component * data() { return components_.data(); }
+         Component const * data() const { return components_.data(); }
+
+      private:
+         std::vector<Component> components_;
+      };
+
+      //
+      // ComponentStore Implementation
+      //
+
+      template <typename Component>
+      template <typename... Args>
+      Component & ComponentStore<Component>::emplace(std::uint32_t index, Args &&... args)
+      {
+         components_.emplace_back(std::forward<Args>(args)...);
+         try
+         {
+            insertIndex(index);
+         }
+         catch (...)
+         {
+            components_.pop_back();
+            throw;
+         }
+         return components_.back();
+      }
+
+      template <typename Component>
+      void ComponentStore<Component>::remove(std::uint32_t index)
+      {
+         auto position = sparse_[index];
+         if (position + 1 != components_.size()) components_[position] = std::move(components_.back());
+         components_.pop_back();
+         removeIndex(index);
+      }
+
+   } // namespace impl
+} // namespace pcx
+
+#endif // #ifndef PCX_COMPONENT_STORE_H
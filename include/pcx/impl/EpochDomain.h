@@ -0,0 +1,106 @@
+#ifndef PCX_EPOCH_DOMAIN_H
+#define PCX_EPOCH_DOMAIN_H
+
+#include <atomic>
+#include <cstdint>
+#include <vector>
+#include <utility>
+
+namespace pcx
+{
+   namespace impl
+   {
+      /**
+       * @brief Base class for objects that are unlinked from a lock-free structure
+       * and handed to a RetireList for deferred deletion
+       */
+      class Retirable
+      {
+      public:
+         virtual ~Retirable() {}
+      };
+
+      /**
+       * @brief The EpochDomain class implements epoch based reclamation for
+       * lock-free read paths.
+       * Readers bracket their accesses with an EpochGuard, which costs a single
+       * store to a thread-local (cache line padded) record. Writers replace shared
+       * objects and retire the old ones, which are deleted only once every reader
+       * that could still see them has left its critical section.
+       * There is a single process-wide domain; reader records are reused as
+       * threads come and go and live for the life of the process.
+       */
+      class EpochDomain
+      {
+      public:
+         static EpochDomain & instance();
+
+         // reentrant: only the outermost enter/leave pair publishes the epoch
+         void enter();
+         void leave();
+
+         // bumps the global epoch, returning the epoch in which anything already
+         // unlinked was retired
+         std::uint64_t advance();
+
+         // the oldest epoch any reader may currently be in (UINT64_MAX if none)
+         std::uint64_t minActiveEpoch() const;
+
+         struct ReaderRecord;
+
+      private:
+         EpochDomain();
+         EpochDomain(EpochDomain const &);
+         EpochDomain & operator=(EpochDomain const &);
+
+         ReaderRecord & localRecord();
+
+         std::atomic<std::uint64_t> epoch_;
+         std::atomic<ReaderRecord*> records_;
+      };
+
+      /**
+       * @brief Scoped reader critical section
+       */
+      class EpochGuard
+      {
+      public:
+         EpochGuard() { EpochDomain::instance().enter(); }
+         ~EpochGuard() { EpochDomain::instance().leave(); }
+
+      private:
+         EpochGuard(EpochGuard const &);
+         EpochGuard & operator=(EpochGuard const &);
+      };
+
+      /**
+       * @brief Objects waiting to be reclaimed. Not thread safe: owned by a
+       * structure's writer side, which is expected to serialise its writers.
+       * Anything still retired when the list is destroyed is deleted immediately,
+       * so owners must ensure readers have finished by then.
+       */
+      class RetireList
+      {
+      public:
+         RetireList() {}
+         ~RetireList();
+
+         // obj must already be unreachable for new readers
+         void retire(Retirable * obj);
+
+         // deletes everything no reader can still reference
+         void reclaim();
+
+         std::size_t size() const { return retired_.size(); }
+
+      private:
+         RetireList(RetireList const &);
+         RetireList & operator=(RetireList const &);
+
+         std::vector<std::pair<std::uint64_t, Retirable*>> retired_;
+      };
+
+   } // namespace impl
+} // namespace pcx
+
+#endif // #ifndef PCX_EPOCH_DOMAIN_H
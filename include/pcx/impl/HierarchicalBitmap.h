@@ -0,0 +1,43 @@
+#ifndef PCX_HIERARCHICAL_BITMAP_H
+#define PCX_HIERARCHICAL_BITMAP_H
+
+#include <cstdint>
+#include <vector>
+
+namespace pcx
+{
+   namespace impl
+   {
+      /**
+       * @brief A bitmap that finds its lowest set bit in a few steps however large
+       * it is. Above the bits themselves is a level with a bit per non-zero word,
+       * and so on up to a single word, so a search takes one count-trailing-zeros
+       * per level (four levels cover 16M bits).
+       */
+      class HierarchicalBitmap
+      {
+      public:
+         HierarchicalBitmap() : size_(0) { }
+
+         long size() const { return size_; }
+
+         /// Added bits are clear
+         void resize(long size);
+
+         bool test(long index) const { return 0 != (levels_[0][index / 64] & (std::uint64_t(1) << (index % 64))); }
+         void set(long index);
+         void clear(long index);
+
+         /// @return the lowest set bit, or -1 if none are set
+         long lowest() const;
+
+      private:
+         long size_;
+         // levels_[0] holds the bits, each level above a bit per non-zero word of the one below
+         std::vector<std::vector<std::uint64_t>> levels_;
+      };
+
+   } // namespace impl
+} // namespace pcx
+
+#endif // #ifndef PCX_HIERARCHICAL_BITMAP_H
@@ -0,0 +1,168 @@
+#ifndef PCX_INPLACE_FUNCTION_H
+#define PCX_INPLACE_FUNCTION_H
+
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace pcx
+{
+   namespace impl
+   {
+      template <typename Signature, std::size_t Capacity = 4 * sizeof(void*)>
+      class InplaceFunction;
+
+      /**
+       * @brief A copyable callable wrapper like std::function, but one that stores
+       * callables of up to Capacity bytes (lambdas capturing a few pointers, bound
+       * member functions) inside the object itself, so that holding one in a
+       * contiguous container needs no further allocation. Larger callables fall
+       * back to the heap.
+       */
+      template <typename R, typename... Args, std::size_t Capacity>
+      class InplaceFunction<R(Args...), Capacity>
+      {
+      public:
+         InplaceFunction() : ops_(nullptr) { }
+
+         template <typename F, typename = typename std::enable_if<
+            !std::is_same<typename std::decay<F>::type, InplaceFunction>::value>::type>
+         InplaceFunction(F && f) : ops_(nullptr)
+         {
+            typedef typename std::decay<F>::type FunctorT;
+            typedef typename std::conditional<fitsInline<FunctorT>(), InlineOps<FunctorT>, HeapOps<FunctorT>>::type OpsT;
+
+            OpsT::construct(&storage_, std::forward<F>(f));
+            ops_ = &OpsT::ops;
+         }
+
+         InplaceFunction(InplaceFunction const & other) : ops_(other.ops_)
+         {
+            if (ops_) ops_->copy(&storage_, &other.storage_);
+         }
+
+         InplaceFunction(InplaceFunction && other) noexcept : ops_(other.ops_)
+         {
+            if (ops_) ops_->move(&storage_, &other.storage_);
+            other.ops_ = nullptr;
+         }
+
+         ~InplaceFunction()
+         {
+            if (ops_) ops_->destroy(&storage_);
+         }
+
+         InplaceFunction & operator=(InplaceFunction const & other)
+         {
+            if (this != &other)
+            {
+               InplaceFunction copy(other);
+               *this = std::move(copy);
+            }
+            return *this;
+         }
+
+         InplaceFunction & operator=(InplaceFunction && other) noexcept
+         {
+            if (this != &other)
+            {
+               if (ops_) ops_->destroy(&storage_);
+               ops_ = other.ops_;
+               if (ops_) ops_->move(&storage_, &other.storage_);
+               other.ops_ = nullptr;
+            }
+            return *this;
+         }
+
+         R operator()(Args... args) const
+         {
+            return ops_->invoke(&storage_, std::forward<Args>(args)...);
+         }
+
+         explicit operator bool() const { return nullptr != ops_; }
+
+         /// Binds a member function to an object without any allocation or indirection
+         /// through a std::function/std::bind
+         template <typename T, R (T::*Method)(Args...)>
+         static InplaceFunction bind(T & object)
+         {
+            return InplaceFunction(MemberCall<T, Method>{ &object });
+         }
+
+      private:
+         typedef typename std::aligned_storage<Capacity, alignof(std::max_align_t)>::type StorageT;
+
+         struct Ops
+         {
+            R (*invoke)(void *, Args&&...);
+            void (*copy)(void *, void const *);
+            void (*move)(void *, void *);         // leaves the source destroyed, never throws
+            void (*destroy)(void *);
+         };
+
+         template <typename F>
+         static constexpr bool fitsInline()
+         {
+            return sizeof(F) <= sizeof(StorageT)
+               && alignof(F) <= alignof(StorageT)
+               && std::is_nothrow_move_constructible<F>::value;
+         }
+
+         template <typename F>
+         struct InlineOps
+         {
+            template <typename FArg>
+            static void construct(void * p, FArg && f) { new (p) F(std::forward<FArg>(f)); }
+
+            static R invoke(void * p, Args&&... args) { return (*static_cast<F*>(p))(std::forward<Args>(args)...); }
+            static void copy(void * dest, void const * src) { new (dest) F(*static_cast<F const*>(src)); }
+            static void move(void * dest, void * src)
+            {
+               new (dest) F(std::move(*static_cast<F*>(src)));
+               static_cast<F*>(src)->~F();
+            }
+            static void destroy(void * p) { static_cast<F*>(p)->~F(); }
+
+            static const Ops ops;
+         };
+
+         template <typename F>
+         struct HeapOps
+         {
+            template <typename FArg>
+            static void construct(void * p, FArg && f) { *static_cast<F**>(p) = new F(std::forward<FArg>(f)); }
+
+            static R invoke(void * p, Args&&... args) { return (**static_cast<F**>(p))(std::forward<Args>(args)...); }
+            static void copy(void * dest, void const * src) { *static_cast<F**>(dest) = new F(**static_cast<F* const*>(src)); }
+            static void move(void * dest, void * src) { *static_cast<F**>(dest) = *static_cast<F**>(src); }
+            static void destroy(void * p) { delete *static_cast<F**>(p); }
+
+            static const Ops ops;
+         };
+
+         template <typename T, R (T::*Method)(Args...)>
+         struct MemberCall
+         {
+            T * object;
+            R operator()(Args... args) const { return (object->*Method)(std::forward<Args>(args)...); }
+         };
+
+         mutable StorageT storage_;
+         Ops const * ops_;
+      };
+
+      template <typename R, typename... Args, std::size_t Capacity>
+      template <typename F>
+      const typename InplaceFunction<R(Args...), Capacity>::Ops
+         InplaceFunction<R(Args...), Capacity>::InlineOps<F>::ops = { &invoke, &copy, &move, &destroy };
+
+      template <typename R, typename... Args, std::size_t Capacity>
+      template <typename F>
+      const typename InplaceFunction<R(Args...), Capacity>::Ops
+         InplaceFunction<R(Args...), Capacity>::HeapOps<F>::ops = { &invoke, &copy, &move, &destroy };
+
+   } // namespace impl
+} // namespace pcx
+
+#endif // #ifndef PCX_INPLACE_FUNCTION_H
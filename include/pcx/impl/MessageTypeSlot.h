@@ -0,0 +1,38 @@
+#ifndef PCX_MESSAGE_TYPE_SLOT_H
+#define PCX_MESSAGE_TYPE_SLOT_H
+
+#include <cstddef>
+#include <cstdint>
+#include <typeinfo>
+
+#include <pcx/impl/TypeSlot.h>
+
+namespace pcx
+{
+   namespace impl
+   {
+      struct MessageTypeTag;
+
+      /**
+       * @brief Maps each message type to a dense TypeSlot so that message buses
+       * can index their dispatch tables directly
+       */
+      template <typename Message>
+      using MessageTypeSlot = TypeSlot<MessageTypeTag, Message>;
+
+      /// Identifies a message type outside this process, e.g. in a recording or
+      /// shared memory (a hash of its type name, so only stable between builds from
+      /// the same compiler)
+      std::uint64_t messageTypeId(char const * typeName);
+
+      template <typename Message>
+      std::uint64_t messageTypeId()
+      {
+         static const std::uint64_t id = messageTypeId(typeid(Message).name());
+         return id;
+      }
+
+   } // namespace impl
+} // namespace pcx
+
+#endif // #ifndef PCX_MESSAGE_TYPE_SLOT_H
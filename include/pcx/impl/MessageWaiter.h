@@ -0,0 +1,92 @@
+#ifndef PCX_MESSAGE_WAITER_H
+#define PCX_MESSAGE_WAITER_H
+
+namespace pcx
+{
+   namespace impl
+   {
+      class WaiterList;
+
+      /**
+       * @brief A suspended wait for a message, linked into the list of whoever will
+       * resume it. Lives inside the waiting coroutine's frame (see MessageBus::Next),
+       * so waiting allocates nothing.
+       */
+      struct MessageWaiter
+      {
+         MessageWaiter(void * sender, bool anySender, bool deferred)
+            : list(nullptr), prev(nullptr), next(nullptr)
+            , sender(sender), anySender(anySender), deferred(deferred)
+            , coroutine(nullptr), resume(nullptr), deliver(nullptr) { }
+
+         bool matches(void * messageSender) const { return anySender || sender == messageSender; }
+
+         WaiterList * list;         // the list this waiter is linked into, if any
+         MessageWaiter * prev;
+         MessageWaiter * next;
+
+         void * sender;
+         bool anySender;
+         bool deferred;             // resume from dispatchPending rather than from publish
+
+         void * coroutine;          // the suspended coroutine's address
+         void (*resume)(void * coroutine);
+         void (*deliver)(MessageWaiter & waiter, void * sender, void const * message);
+      };
+
+      /**
+       * @brief Intrusive doubly linked FIFO of MessageWaiters
+       */
+      class WaiterList
+      {
+      public:
+         WaiterList() : head_(nullptr), tail_(nullptr) { }
+
+         bool empty() const { return nullptr == head_; }
+
+         /// Moves waiter here from whatever list it was in
+         void push_back(MessageWaiter & waiter)
+         {
+            if (waiter.list) waiter.list->remove(waiter);
+            waiter.list = this;
+            waiter.prev = tail_;
+            waiter.next = nullptr;
+            if (tail_) tail_->next = &waiter;
+            else head_ = &waiter;
+            tail_ = &waiter;
+         }
+
+         MessageWaiter * pop_front()
+         {
+            auto * waiter = head_;
+            if (waiter) remove(*waiter);
+            return waiter;
+         }
+
+         void remove(MessageWaiter & waiter)
+         {
+            if (waiter.prev) waiter.prev->next = waiter.next;
+            else head_ = waiter.next;
+            if (waiter.next) waiter.next->prev = waiter.prev;
+            else tail_ = waiter.prev;
+            waiter.list = nullptr;
+            waiter.prev = waiter.next = nullptr;
+         }
+
+         /// Moves all of other's waiters to the end of this list
+         void splice(WaiterList & other)
+         {
+            while (auto * waiter = other.pop_front()) push_back(*waiter);
+         }
+
+      private:
+         WaiterList(WaiterList const &);
+         WaiterList & operator=(WaiterList const &);
+
+         MessageWaiter * head_;
+         MessageWaiter * tail_;
+      };
+   } // namespace impl
+} // namespace pcx
+
+#endif // #ifndef PCX_MESSAGE_WAITER_H
@@ -0,0 +1,39 @@
+#ifndef PCX_TYPE_SLOT_H
+#define PCX_TYPE_SLOT_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace pcx
+{
+   namespace impl
+   {
+      /// Returns the next unused slot of Tag (thread safe)
+      template <typename Tag>
+      std::size_t allocateTypeSlot()
+      {
+         static std::atomic<std::size_t> nextSlot(0);
+         return nextSlot++;
+      }
+
+      /**
+       * @brief Maps each type T to a small, dense, process-wide integer so that
+       * tables keyed by type can be indexed directly instead of hashing a
+       * type_index. Each Tag numbers its types separately from 0, so unrelated
+       * tables (message types, component types) stay dense. Slots are assigned on
+       * first use and never reused.
+       */
+      template <typename Tag, typename T>
+      struct TypeSlot
+      {
+         static std::size_t value()
+         {
+            static const std::size_t slot = allocateTypeSlot<Tag>();
+            return slot;
+         }
+      };
+
+   } // namespace impl
+} // namespace pcx
+
+#endif // #ifndef PCX_TYPE_SLOT_H
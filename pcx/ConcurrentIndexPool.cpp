@@ -0,0 +1,186 @@
+#include <pcx/ConcurrentIndexPool.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <thread>
+
+namespace pcx
+{
+   namespace
+   {
+      // threads are shared out between the magazines of every pool in turn
+      std::atomic<unsigned> nextThreadSlot(0);
+      thread_local unsigned threadSlot = nextThreadSlot.fetch_add(1, std::memory_order_relaxed);
+
+      std::uint64_t makeHead(std::uint64_t previous, std::uint32_t index)
+      {
+         // bumping the tag on every change means a stale head never compares equal
+         return (((previous >> 32) + 1) << 32) | index;
+      }
+   }
+
+   const std::uint32_t ConcurrentIndexPool::npos;
+   const std::uint32_t ConcurrentIndexPool::MagazineSize;
+
+   ConcurrentIndexPool::ConcurrentIndexPool(long size, unsigned magazines)
+      : size_(size)
+      , head_(0), sharedNet_(0)
+   {
+      if (size <= 0 || size >= static_cast<long>(npos)) throw std::runtime_error("IndexPool size must be positive and fit 32 bits");
+
+      next_.reset(new std::atomic<std::uint32_t>[size]);
+      for (long i = 0; i < size; ++i) next_[i].store(i + 1 < size ? static_cast<std::uint32_t>(i + 1) : npos, std::memory_order_relaxed);
+
+#if PCX_CONCURRENT_INDEX_POOL_CHECKS
+      allocated_.reset(new std::atomic<bool>[size]);
+      for (long i = 0; i < size; ++i) allocated_[i].store(false, std::memory_order_relaxed);
+#endif
+
+      if (0 == magazines) magazines = std::max(1u, 2 * std::thread::hardware_concurrency());
+      for (unsigned i = 0; i < magazines; ++i) magazines_.push_back(std::unique_ptr<Magazine>(new Magazine()));
+   }
+
+   long ConcurrentIndexPool::Allocate()
+   {
+      auto index = npos;
+
+      if (auto * magazine = LocalMagazine())
+      {
+         if (0 == magazine->count) magazine->count = PopChain(magazine->indices, MagazineSize / 2);
+         index = Take(*magazine);
+         magazine->locked.store(false, std::memory_order_release);
+      }
+
+      if (npos == index)
+      {
+         index = Pop();
+         if (npos != index) sharedNet_.fetch_add(1, std::memory_order_relaxed);
+      }
+
+      // the stack is empty, but other threads may have free indices cached
+      for (std::size_t i = 0; npos == index && i < magazines_.size(); ++i)
+      {
+         auto & other = *magazines_[i];
+         if (!TryLock(other)) continue;
+         index = Take(other);
+         other.locked.store(false, std::memory_order_release);
+      }
+
+      if (npos == index) throw std::runtime_error("Free list full");
+
+#if PCX_CONCURRENT_INDEX_POOL_CHECKS
+      allocated_[index].store(true, std::memory_order_relaxed);
+#endif
+      return index;
+   }
+
+   void ConcurrentIndexPool::Free(long index)
+   {
+      if (index < 0 || index >= size_) throw std::runtime_error("Assertion failure: index out of range");
+
+#if PCX_CONCURRENT_INDEX_POOL_CHECKS
+      if (!allocated_[index].exchange(false, std::memory_order_relaxed)) throw std::runtime_error("Assertion failure: index not allocated");
+#endif
+
+      auto slot = static_cast<std::uint32_t>(index);
+
+      if (auto * magazine = LocalMagazine())
+      {
+         if (MagazineSize == magazine->count)
+         {
+            // return the older half to the stack as one chain
+            const auto half = MagazineSize / 2;
+            PushChain(magazine->indices, half);
+            std::copy(magazine->indices + half, magazine->indices + MagazineSize, magazine->indices);
+            magazine->count -= half;
+         }
+
+         magazine->indices[magazine->count++] = slot;
+         magazine->net.store(magazine->net.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+         magazine->locked.store(false, std::memory_order_release);
+         return;
+      }
+
+      PushChain(&slot, 1);
+      sharedNet_.fetch_sub(1, std::memory_order_relaxed);
+   }
+
+   bool ConcurrentIndexPool::IsAllocated(long index) const
+   {
+#if PCX_CONCURRENT_INDEX_POOL_CHECKS
+      return index >= 0 && index < size_ && allocated_[index].load(std::memory_order_relaxed);
+#else
+      (void)index;
+      throw std::runtime_error("ConcurrentIndexPool::IsAllocated needs PCX_CONCURRENT_INDEX_POOL_CHECKS");
+#endif
+   }
+
+   long ConcurrentIndexPool::Size() const
+   {
+      auto size = sharedNet_.load(std::memory_order_relaxed);
+      for (auto & magazine : magazines_) size += magazine->net.load(std::memory_order_relaxed);
+      return size;
+   }
+
+   ConcurrentIndexPool::Magazine * ConcurrentIndexPool::LocalMagazine()
+   {
+      auto & magazine = *magazines_[threadSlot % magazines_.size()];
+      return TryLock(magazine) ? &magazine : nullptr;
+   }
+
+   bool ConcurrentIndexPool::TryLock(Magazine & magazine)
+   {
+      return !magazine.locked.load(std::memory_order_relaxed)
+         && !magazine.locked.exchange(true, std::memory_order_acquire);
+   }
+
+   std::uint32_t ConcurrentIndexPool::Take(Magazine & magazine)
+   {
+      if (0 == magazine.count) return npos;
+      // only the thread holding the magazine writes to net, so it needs no read-modify-write
+      magazine.net.store(magazine.net.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return magazine.indices[--magazine.count];
+   }
+
+   std::uint32_t ConcurrentIndexPool::Pop()
+   {
+      std::uint32_t index;
+      return 0 == PopChain(&index, 1) ? npos : index;
+   }
+
+   std::uint32_t ConcurrentIndexPool::PopChain(std::uint32_t * out, std::uint32_t max)
+   {
+      auto head = head_.load(std::memory_order_acquire);
+      for (;;)
+      {
+         // the links walked here may be changed by other threads as they are read,
+         // in which case the head has moved on too and the exchange below fails
+         std::uint32_t count = 0;
+         auto index = static_cast<std::uint32_t>(head);
+         while (npos != index && count < max && index < static_cast<std::uint32_t>(size_))
+         {
+            out[count++] = index;
+            index = next_[index].load(std::memory_order_relaxed);
+         }
+
+         if (0 == count) return 0;
+         if (head_.compare_exchange_weak(head, makeHead(head, index), std::memory_order_acquire, std::memory_order_acquire))
+         {
+            return count;
+         }
+      }
+   }
+
+   void ConcurrentIndexPool::PushChain(std::uint32_t const * indices, std::uint32_t count)
+   {
+      for (std::uint32_t i = 1; i < count; ++i) next_[indices[i - 1]].store(indices[i], std::memory_order_relaxed);
+
+      auto last = indices[count - 1];
+      auto head = head_.load(std::memory_order_relaxed);
+      do
+      {
+         next_[last].store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+      } while (!head_.compare_exchange_weak(head, makeHead(head, indices[0]), std::memory_order_release, std::memory_order_relaxed));
+   }
+
+} // namespace pcx
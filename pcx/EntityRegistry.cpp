@@ -0,0 +1,51 @@
+#include <pcx/EntityRegistry.h>
+
+namespace pcx
+{
+   EntityRegistry::EntityRegistry()
+      : pool_(0, 1 << 12)
+   {
+   }
+
+   EntityRegistry::EntityRegistry(ServiceRegistry &)
+      : pool_(0, 1 << 12)
+   {
+   }
+
+   Entity EntityRegistry::create()
+   {
+      auto index = pool_.Allocate();
+      try
+      {
+         if (generations_.size() < static_cast<std::size_t>(pool_.Reserved())) generations_.resize(pool_.Reserved(), 0);
+      }
+      catch (...)
+      {
+         pool_.Free(index);
+         throw;
+      }
+      return Entity(static_cast<std::uint32_t>(index), generations_[index]);
+   }
+
+   bool EntityRegistry::destroy(Entity entity)
+   {
+      if (!isAlive(entity)) return false;
+
+      for (auto & store : stores_)
+      {
+         if (store && store->contains(entity.index)) store->remove(entity.index);
+      }
+
+      ++generations_[entity.index];
+      pool_.Free(entity.index);
+      return true;
+   }
+
+   bool EntityRegistry::isAlive(Entity entity) const
+   {
+      return entity.index < generations_.size()
+         && pool_.IsAllocated(entity.index)
+         && generations_[entity.index] == entity.generation;
+   }
+
+} // namespace pcx
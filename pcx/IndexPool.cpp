@@ -1,105 +1,468 @@
 #include <pcx/IndexPool.h>
+#include <pcx/WorkerPool.h>
 
-#include <exception>
+#include <limits>
+#include <stdexcept>
 
 namespace pcx
 {
-      IndexPool::IndexPool(long size)
-         : reserved_(size), size_(0)
-         , freeListStart_(0), freeListEnd_(reserved_ - 1)
+      namespace impl
+      {
+         int chunkShiftOf(long chunkSize)
+         {
+            if (chunkSize <= 0 || 0 != (chunkSize & (chunkSize - 1)))
+            {
+               throw std::runtime_error("Chunk size must be a power of two");
+            }
+
+            int shift = 0;
+            while ((1L << shift) != chunkSize) ++shift;
+            return shift;
+         }
+      } // namespace impl
+
+      template <typename Index>
+      BasicIndexPool<Index>::BasicIndexPool(long size, AllocationPolicy policy)
+         : policy_(policy), growable_(false)
+         // every index falls in the one chunk
+         , chunkShift_(std::numeric_limits<long>::digits), chunkMask_(std::numeric_limits<long>::max())
+         , minChunks_(1)
+         , reserved_(0), size_(0)
+         , freeListStart_(-1), freeListEnd_(-1)
          , allocListStart_(-1), allocListEnd_(-1)
-         , refList_(size), backRefList_(size)
       {
-         for (long i = 0; i < size; ++i)
+         AddChunk(size);
+      }
+
+      template <typename Index>
+      BasicIndexPool<Index>::BasicIndexPool(long size, long chunkSize, AllocationPolicy policy)
+         : policy_(policy), growable_(true)
+         , chunkShift_(impl::chunkShiftOf(chunkSize)), chunkMask_(chunkSize - 1)
+         , minChunks_(std::max(1L, (size + chunkMask_) >> chunkShift_))
+         , reserved_(0), size_(0)
+         , freeListStart_(-1), freeListEnd_(-1)
+         , allocListStart_(-1), allocListEnd_(-1)
+      {
+         for (long i = 0; i < minChunks_; ++i) AddChunk(chunkSize);
+      }
+
+      template <typename Index>
+      void BasicIndexPool<Index>::AddChunk(long size)
+      {
+         if (size <= 0) throw std::runtime_error("IndexPool size must be positive");
+         if (static_cast<unsigned long long>(reserved_) + size > npos)
          {
-            refList_[i] = std::make_pair(false, i + 1);
+            throw std::runtime_error("IndexPool size does not fit its index type");
          }
-         refList_[size - 1].second = -1;
+
+         chunks_.push_back(std::unique_ptr<Chunk>(new Chunk(size)));
+
+         auto first = reserved_;
+         reserved_ += size;
+
+         auto & chunk = *chunks_.back();
+
+         if (AllocationPolicy::LowestFree == policy_)
+         {
+            free_.resize(reserved_);
+            for (long i = 0; i < size; ++i) free_.set(first + i);
+            return;
+         }
+
+         for (long i = 0; i + 1 < size; ++i)
+         {
+            chunk.next[i] = ToLink(first + i + 1);
+         }
+
+         // add the new indices to the end of the 'free' list
+         if (-1 == freeListStart_) freeListStart_ = first;
+         else SetNext(freeListEnd_, first);
+         freeListEnd_ = reserved_ - 1;
       }
 
-      long IndexPool::Allocate()
+      template <typename Index>
+      long BasicIndexPool<Index>::Allocate()
       {
-         if (-1 == freeListStart_) throw std::runtime_error("Free list full");
+         if (size_ == reserved_)
+         {
+            if (!growable_) throw std::runtime_error("Free list full");
+            AddChunk(chunkMask_ + 1);
+         }
 
-         auto index = freeListStart_;
+         auto index = AllocationPolicy::LowestFree == policy_ ? free_.lowest() : freeListStart_;
 
-         if (refList_[index].first)
+         if (IsOccupied(index))
          {
             throw std::runtime_error("Assertion failure: index already allocated");
          }
 
-         // take this index from the start of the 'free' list
-         freeListStart_ = refList_[index].second;
+         if (AllocationPolicy::LowestFree == policy_)
+         {
+            free_.clear(index);
+         }
+         else
+         {
+            // take this index from the start of the 'free' list
+            freeListStart_ = NextOf(index);
+            if (-1 == freeListStart_) freeListEnd_ = -1;
+         }
+
+         Link(index);
+         return index;
+      }
+
+      template <typename Index>
+      void BasicIndexPool<Index>::Allocate(long count, Span<long> out)
+      {
+         if (count < 0 || static_cast<std::size_t>(count) > out.size())
+         {
+            throw std::runtime_error("IndexPool batch does not fit its output");
+         }
+
+         if (count > reserved_ - size_)
+         {
+            if (!growable_) throw std::runtime_error("Free list full");
+
+            // grow up front, giving back any chunks added if that fails part way
+            auto chunks = static_cast<long>(chunks_.size());
+            try
+            {
+               while (count > reserved_ - size_) AddChunk(chunkMask_ + 1);
+            }
+            catch (...)
+            {
+               ReleaseChunks(chunks);
+               throw;
+            }
+         }
+
+         // nothing below throws
+
+         if (AllocationPolicy::LowestFree == policy_)
+         {
+            for (long i = 0; i < count; ++i)
+            {
+               auto index = free_.lowest();
+               free_.clear(index);
+               Link(index);
+               out[i] = index;
+            }
+            return;
+         }
+
+         if (0 == count) return;
+
+         // the run at the start of the 'free' list is already linked in order,
+         // so it is cut off and appended to the 'alloc' list as it is
+         auto first = freeListStart_;
+         auto last = allocListEnd_;
+         auto index = first;
+         for (long i = 0; i < count; ++i)
+         {
+            SetPrev(index, last);
+            SetOccupied(index, true);
+            ++ChunkOf(index).used;
+            out[i] = index;
+
+            last = index;
+            index = NextOf(index);
+         }
+         SetNext(last, -1);
+
+         freeListStart_ = index;
          if (-1 == freeListStart_) freeListEnd_ = -1;
 
+         if (-1 == allocListStart_) allocListStart_ = first;
+         else SetNext(allocListEnd_, first);
+         allocListEnd_ = last;
+
+         size_ += count;
+      }
+
+      template <typename Index>
+      void BasicIndexPool<Index>::Link(long index)
+      {
          auto first = -1 == allocListStart_;
 
          // add this index to the end of the 'alloc' list
          if (!first)
          {
-            refList_[allocListEnd_].second = index;
-            backRefList_[index] = allocListEnd_;
+            SetNext(allocListEnd_, index);
+            SetPrev(index, allocListEnd_);
             allocListEnd_ = index;
          }
          else
          {
             allocListStart_ = allocListEnd_ = index;
-            backRefList_[index] = -1;
+            SetPrev(index, -1);
          }
 
-         // update this element 
-         refList_[index].second = -1;
-         refList_[index].first = true;
+         // update this element
+         SetNext(index, -1);
 
+         SetOccupied(index, true);
+         ++ChunkOf(index).used;
          ++size_;
-
-         return index;
       }
 
-      void IndexPool::Free(long index)
+      template <typename Index>
+      void BasicIndexPool<Index>::Free(long index)
       {
-         if (!refList_[index].first)
+         if (!IsAllocated(index))
          {
             throw std::runtime_error("Assertion failure: index not allocated");
          }
 
-         // remove this index from the linked list
-         auto next = refList_[index].second;
-         auto prev = backRefList_[index];
+         Unlink(index);
+
+         if (AllocationPolicy::LowestFree == policy_)
+         {
+            free_.set(index);
+         }
+         else if (freeListStart_ == -1)
+         {
+            freeListStart_ = freeListEnd_ = index;
+         }
+         else
+         {
+            // add to the end of the free list
+            SetNext(freeListEnd_, index);
+            freeListEnd_ = index;
+         }
 
-         refList_[index].first = false;
-         refList_[index].second = freeListEnd_;
+         --size_;
+      }
 
-         if (prev != -1) refList_[prev].second = next;
-         if (next != -1) backRefList_[next] = prev;
+      template <typename Index>
+      void BasicIndexPool<Index>::Free(Span<long const> indices)
+      {
+         // check every index before freeing any, clearing their occupied bits as
+         // they are checked so that an index given twice is caught too
+         for (std::size_t i = 0; i < indices.size(); ++i)
+         {
+            auto index = indices[i];
+            if (index < 0 || index >= reserved_ || !IsOccupied(index))
+            {
+               for (std::size_t j = 0; j < i; ++j) SetOccupied(indices[j], true);
+               throw std::runtime_error("Assertion failure: index not allocated");
+            }
+            SetOccupied(index, false);
+         }
+
+         if (indices.empty()) return;
+
+         for (auto index : indices) Unlink(index);
+
+         if (AllocationPolicy::LowestFree == policy_)
+         {
+            for (auto index : indices) free_.set(index);
+         }
+         else
+         {
+            // chain the indices in the order given and add them to the end of the free list as one run
+            for (std::size_t i = 1; i < indices.size(); ++i) SetNext(indices[i - 1], indices[i]);
+
+            if (-1 == freeListStart_) freeListStart_ = indices[0];
+            else SetNext(freeListEnd_, indices[0]);
+            freeListEnd_ = indices[indices.size() - 1];
+         }
+
+         size_ -= static_cast<long>(indices.size());
+      }
+
+      template <typename Index>
+      void BasicIndexPool<Index>::Unlink(long index)
+      {
+         // remove this index from the linked list
+         auto next = NextOf(index);
+         auto prev = PrevOf(index);
+
+         SetNext(index, -1);
 
          if (-1 == prev)
          {
             // freeing the head of the 'alloc' list
             allocListStart_ = next;
-            backRefList_[next] = -1;
+         }
+         else
+         {
+            SetNext(prev, next);
          }
 
          if (-1 == next)
          {
             // freeing the tail of the 'alloc' list
             allocListEnd_ = prev;
-            refList_[prev].second = -1;
          }
+         else
+         {
+            SetPrev(next, prev);
+         }
+
+         SetOccupied(index, false);
+         --ChunkOf(index).used;
+      }
+
+      template <typename Index>
+      long BasicIndexPool<Index>::Next(long index) const
+      {
+         if (index < 0 || index >= reserved_) throw std::out_of_range("IndexPool index out of range");
+         return NextOf(index);
+      }
+
+      template <typename Index>
+      std::vector<long> BasicIndexPool<Index>::Compact()
+      {
+         std::vector<long> remap(reserved_, -1);
+         long next = 0;
+         ForEach([&](long index) { remap[index] = next++; });
 
-         if (freeListStart_ == -1)
+         std::vector<long> order;
+         order.reserve(size_);
+         for (auto index = allocListStart_; -1 != index; index = NextOf(index)) order.push_back(remap[index]);
+
+         // nothing below throws
+
+         for (auto & chunk : chunks_)
          {
-            freeListStart_ = freeListEnd_ = index;
+            chunk->used = 0;
+            std::fill(chunk->next.begin(), chunk->next.end(), npos);
+            std::fill(chunk->prev.begin(), chunk->prev.end(), npos);
+            std::fill(chunk->occupied.begin(), chunk->occupied.end(), 0);
          }
-         else
+
+         for (long index = 0; index < size_; ++index)
          {
-            // add to the end of the free list
-            refList_[freeListEnd_].second = index;
+            SetOccupied(index, true);
+            ++ChunkOf(index).used;
+         }
+
+         // the 'alloc' list in the same order as before
+         allocListStart_ = allocListEnd_ = -1;
+         for (auto index : order)
+         {
+            SetPrev(index, allocListEnd_);
+            if (-1 == allocListStart_) allocListStart_ = index;
+            else SetNext(allocListEnd_, index);
+            allocListEnd_ = index;
+         }
+
+         // and everything above is free, in ascending order
+         if (AllocationPolicy::LowestFree == policy_)
+         {
+            for (long index = 0; index < reserved_; ++index)
+            {
+               if (index < size_) free_.clear(index);
+               else free_.set(index);
+            }
+            return remap;
+         }
+
+         freeListStart_ = freeListEnd_ = -1;
+         for (auto index = size_; index < reserved_; ++index)
+         {
+            if (-1 == freeListStart_) freeListStart_ = index;
+            else SetNext(freeListEnd_, index);
             freeListEnd_ = index;
          }
 
-         --size_;
+         return remap;
       }
 
-} // namespace pcx
+      template <typename Index>
+      std::vector<long> BasicIndexPool<Index>::Partition(long grain) const
+      {
+         if (grain < 1) grain = 1;
+
+         auto wordsPerChunk = static_cast<long>(chunks_[0]->occupied.size());
+         auto total = wordsPerChunk * static_cast<long>(chunks_.size());
+
+         std::vector<long> cuts(1, 0);
+         long live = 0;
+         for (long word = 0; word < total; ++word)
+         {
+            auto const & chunk = *chunks_[word / wordsPerChunk];
+            if (0 == chunk.used)
+            {
+               // skip the rest of an empty chunk in one go
+               word += wordsPerChunk - 1 - word % wordsPerChunk;
+               continue;
+            }
+
+            live += impl::popCount(chunk.occupied[word % wordsPerChunk]);
+            if (live >= grain)
+            {
+               cuts.push_back(word + 1);
+               live = 0;
+            }
+         }
+         if (cuts.back() != total) cuts.push_back(total);
+         return cuts;
+      }
+
+      template <typename Index>
+      void BasicIndexPool<Index>::RunRanges(WorkerPool & workers, std::size_t count, std::function<void(std::size_t)> const & run) const
+      {
+         if (0 == count) return;
 
+         TaskGroup group(workers);
+
+         // hand out the second half of the ranges and keep halving the first, so
+         // idle workers steal the largest pieces of work left
+         std::function<void(std::size_t, std::size_t)> split = [&](std::size_t first, std::size_t last)
+         {
+            while (last - first > 1)
+            {
+               auto middle = first + (last - first) / 2;
+               group.run([&split, middle, last]() { split(middle, last); });
+               last = middle;
+            }
+            run(first);
+         };
+
+         // the calling thread joins in from wait(), and everything, including its
+         // own share, finishes before the group (and split) go away
+         group.run([&split, count]() { split(0, count); });
+         group.wait();
+      }
+
+      template <typename Index>
+      long BasicIndexPool<Index>::Shrink()
+      {
+         auto count = static_cast<long>(chunks_.size());
+         while (count > minChunks_ && 0 == chunks_[count - 1]->used) --count;
+         if (count < static_cast<long>(chunks_.size())) ReleaseChunks(count);
+         return reserved_;
+      }
+
+      template <typename Index>
+      void BasicIndexPool<Index>::ReleaseChunks(long count)
+      {
+         auto reserved = count << chunkShift_;
+
+         // unlink the released indices from the 'free' list, keeping its order
+         auto index = freeListStart_;
+         freeListStart_ = freeListEnd_ = -1;
+         while (-1 != index)
+         {
+            auto next = NextOf(index);
+            if (index < reserved)
+            {
+               if (-1 == freeListStart_) freeListStart_ = index;
+               else SetNext(freeListEnd_, index);
+               freeListEnd_ = index;
+               SetNext(index, -1);
+            }
+            index = next;
+         }
+
+         chunks_.resize(count);
+         reserved_ = reserved;
+         if (AllocationPolicy::LowestFree == policy_) free_.resize(reserved_);
+      }
+
+      template class BasicIndexPool<std::uint16_t>;
+      template class BasicIndexPool<std::uint32_t>;
+      template class BasicIndexPool<std::uint64_t>;
+
+} // namespace pcx
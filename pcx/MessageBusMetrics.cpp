@@ -0,0 +1,124 @@
+#include <pcx/MessageBusMetrics.h>
+#include <pcx/MessageBus.h>
+
+#include <algorithm>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <stdexcept>
+
+namespace pcx
+{
+   //
+   // LatencyHistogram
+   //
+   //
+
+   void LatencyHistogram::reset()
+   {
+      std::fill(buckets, buckets + bucketCount, 0);
+   }
+
+   void LatencyHistogram::record(std::chrono::nanoseconds duration)
+   {
+      auto ns = static_cast<std::uint64_t>(std::max<std::chrono::nanoseconds::rep>(duration.count(), 1));
+
+      std::size_t bucket = 0;
+      while (ns >>= 1) ++bucket;
+
+      ++buckets[std::min(bucket, bucketCount - 1)];
+   }
+
+   std::uint64_t LatencyHistogram::count() const
+   {
+      std::uint64_t total = 0;
+      for (auto b : buckets) total += b;
+      return total;
+   }
+
+   std::chrono::nanoseconds LatencyHistogram::percentile(double p) const
+   {
+      auto total = count();
+      if (0 == total) return std::chrono::nanoseconds(0);
+
+      auto target = static_cast<std::uint64_t>(total * (p / 100.0));
+      std::uint64_t seen = 0;
+      for (std::size_t i = 0; i < bucketCount; ++i)
+      {
+         seen += buckets[i];
+         if (seen > target || seen == total) return std::chrono::nanoseconds(std::int64_t(2) << i);
+      }
+      return std::chrono::nanoseconds(std::int64_t(2) << (bucketCount - 1));
+   }
+
+   //
+   // metrics output
+   //
+   //
+
+   void writeMetrics(std::ostream & out, std::vector<MessageTypeMetrics> metrics)
+   {
+      std::sort(metrics.begin(), metrics.end(), [](MessageTypeMetrics const & a, MessageTypeMetrics const & b)
+      {
+         return a.totalDispatchTime > b.totalDispatchTime;
+      });
+
+      out << std::left << std::setw(48) << "message type"
+          << std::right << std::setw(12) << "publishes"
+          << std::setw(8) << "subs"
+          << std::setw(14) << "total us"
+          << std::setw(12) << "mean ns"
+          << std::setw(12) << "max ns" << "\n";
+
+      for (auto & m : metrics)
+      {
+         auto mean = m.publishCount ? m.totalDispatchTime.count() / std::int64_t(m.publishCount) : 0;
+         out << std::left << std::setw(48) << m.name
+             << std::right << std::setw(12) << m.publishCount
+             << std::setw(8) << m.subscriberCount
+             << std::setw(14) << m.totalDispatchTime.count() / 1000
+             << std::setw(12) << mean
+             << std::setw(12) << m.maxDispatchTime.count() << "\n";
+
+         for (auto & sub : m.subscribers)
+         {
+            out << "    subscriber " << std::left << std::setw(6) << sub.handle << std::right
+                << " calls " << sub.latency.count()
+                << "  p50 <" << sub.latency.percentile(50).count() << "ns"
+                << "  p99 <" << sub.latency.percentile(99).count() << "ns\n";
+         }
+      }
+   }
+
+   //
+   // MessageBusMetricsLog
+   //
+   //
+
+   MessageBusMetricsLog::MessageBusMetricsLog(MessageBus const & bus, std::string filename, double intervalSeconds)
+      : bus_(bus), filename_(filename), interval_(intervalSeconds), sinceLastWrite_(0)
+   {
+   }
+
+   void MessageBusMetricsLog::update(double timeSinceLast)
+   {
+      sinceLastWrite_ += timeSinceLast;
+      if (sinceLastWrite_ < interval_) return;
+
+      sinceLastWrite_ = 0;
+      write();
+   }
+
+   void MessageBusMetricsLog::write()
+   {
+      std::ofstream out(filename_, std::ios::app);
+      if (!out) throw std::runtime_error("could not open metrics log '" + filename_ + "'");
+
+      auto now = std::time(nullptr);
+      out << "--- " << std::asctime(std::localtime(&now));
+      writeMetrics(out, bus_.metrics());
+      out << std::endl;
+   }
+
+} // namespace pcx
@@ -0,0 +1,240 @@
+#include <pcx/MessageRecorder.h>
+
+#include <algorithm>
+#include <fstream>
+#include <thread>
+
+#include <boost/filesystem.hpp>
+#include <boost/interprocess/file_mapping.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+
+namespace pcx
+{
+   namespace impl
+   {
+      /**
+       * @brief An append-only log of records in a memory-mapped file.
+       * The file starts with a FileHeader and is followed by 8 byte aligned records,
+       * each a RecordHeader and its payload. The header's used count is updated after
+       * every append so a log is readable even if the writer never closed it.
+       */
+      class MappedLogFile
+      {
+      public:
+         struct FileHeader
+         {
+            char magic[8];
+            std::uint64_t used;       // bytes of records following the header
+         };
+
+         struct RecordHeader
+         {
+            std::uint64_t timestamp;  // ns since the start of the recording
+            std::uint64_t typeId;
+            std::uint64_t sender;
+            std::uint64_t size;       // payload bytes, excluding padding
+         };
+
+         enum class Mode { Write, Read };
+
+         MappedLogFile(std::string const & filename, Mode mode)
+            : filename_(filename), mode_(mode)
+         {
+            namespace bip = boost::interprocess;
+
+            if (Mode::Write == mode_)
+            {
+               std::ofstream create(filename_, std::ios::binary | std::ios::trunc);
+               if (!create) throw std::runtime_error("could not create message log '" + filename_ + "'");
+               create.close();
+
+               remap(initialSize);
+
+               auto & header = fileHeader();
+               std::memcpy(header.magic, magic, sizeof(header.magic));
+               header.used = 0;
+            }
+            else
+            {
+               mapping_ = bip::file_mapping(filename_.c_str(), bip::read_only);
+               region_ = bip::mapped_region(mapping_, bip::read_only);
+
+               if (region_.get_size() < sizeof(FileHeader)
+                  || 0 != std::memcmp(fileHeader().magic, magic, sizeof(magic))
+                  || fileHeader().used > region_.get_size() - sizeof(FileHeader))
+               {
+                  throw std::runtime_error("'" + filename_ + "' is not a message log");
+               }
+            }
+         }
+
+         ~MappedLogFile()
+         {
+            try
+            {
+               close();
+            }
+            catch (...)
+            {
+            }
+         }
+
+         void close()
+         {
+            if (Mode::Write != mode_ || !region_.get_address()) return;
+
+            auto size = sizeof(FileHeader) + fileHeader().used;
+            region_.flush();
+            region_ = boost::interprocess::mapped_region();
+            mapping_ = boost::interprocess::file_mapping();
+            boost::filesystem::resize_file(filename_, size);
+         }
+
+         void append(RecordHeader const & record, void const * payload)
+         {
+            auto recordSize = sizeof(RecordHeader) + padded(record.size);
+            auto offset = sizeof(FileHeader) + fileHeader().used;
+
+            if (offset + recordSize > region_.get_size())
+            {
+               remap(std::max(region_.get_size() * 2, offset + recordSize));
+            }
+
+            auto * dest = static_cast<char*>(region_.get_address()) + offset;
+            std::memcpy(dest, &record, sizeof(RecordHeader));
+            if (record.size) std::memcpy(dest + sizeof(RecordHeader), payload, record.size);
+
+            fileHeader().used += recordSize;
+         }
+
+         template <typename F>
+         void forEach(F f) const
+         {
+            auto * base = static_cast<char const*>(region_.get_address()) + sizeof(FileHeader);
+            auto used = fileHeader().used;
+
+            for (std::uint64_t offset = 0; offset + sizeof(RecordHeader) <= used; )
+            {
+               RecordHeader record;
+               std::memcpy(&record, base + offset, sizeof(RecordHeader));
+
+               auto recordSize = sizeof(RecordHeader) + padded(record.size);
+               if (offset + recordSize > used) throw std::runtime_error("truncated message log '" + filename_ + "'");
+
+               f(record, base + offset + sizeof(RecordHeader));
+               offset += recordSize;
+            }
+         }
+
+      private:
+         static const std::size_t initialSize = 1 << 20;
+         static const char magic[8];
+
+         static std::uint64_t padded(std::uint64_t size) { return (size + 7) & ~std::uint64_t(7); }
+
+         FileHeader & fileHeader() const
+         {
+            return *static_cast<FileHeader*>(region_.get_address());
+         }
+
+         void remap(std::size_t size)
+         {
+            namespace bip = boost::interprocess;
+
+            if (region_.get_address()) region_.flush();
+            region_ = bip::mapped_region();
+            mapping_ = bip::file_mapping();
+
+            boost::filesystem::resize_file(filename_, size);
+
+            mapping_ = bip::file_mapping(filename_.c_str(), bip::read_write);
+            region_ = bip::mapped_region(mapping_, bip::read_write);
+         }
+
+         std::string filename_;
+         Mode mode_;
+         boost::interprocess::file_mapping mapping_;
+         boost::interprocess::mapped_region region_;
+      };
+
+      const char MappedLogFile::magic[8] = { 'P', 'C', 'X', 'M', 'L', 'O', 'G', '1' };
+
+   } // namespace impl
+
+   //
+   // MessageRecorder
+   //
+   //
+
+   MessageRecorder::MessageRecorder(std::string const & filename)
+      : log_(new impl::MappedLogFile(filename, impl::MappedLogFile::Mode::Write))
+      , start_(std::chrono::steady_clock::now())
+      , recordCount_(0)
+   {
+   }
+
+   MessageRecorder::~MessageRecorder()
+   {
+   }
+
+   void MessageRecorder::stop()
+   {
+      subscriptions_.clear();
+      log_->close();
+   }
+
+   void MessageRecorder::append(std::uint64_t typeId, void* sender, void const * data, std::size_t size)
+   {
+      impl::MappedLogFile::RecordHeader record;
+      record.timestamp = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+      record.typeId = typeId;
+      record.sender = reinterpret_cast<std::uintptr_t>(sender);
+      record.size = size;
+
+      log_->append(record, data);
+      ++recordCount_;
+   }
+
+   //
+   // MessageReplayer
+   //
+   //
+
+   MessageReplayer::MessageReplayer(std::string const & filename)
+      : log_(new impl::MappedLogFile(filename, impl::MappedLogFile::Mode::Read))
+      , skippedCount_(0)
+   {
+   }
+
+   MessageReplayer::~MessageReplayer()
+   {
+   }
+
+   std::size_t MessageReplayer::replay(MessageBus & bus, Pacing pacing)
+   {
+      auto start = std::chrono::steady_clock::now();
+      std::size_t published = 0;
+
+      log_->forEach([&](impl::MappedLogFile::RecordHeader const & record, char const * payload)
+      {
+         auto it = publishers_.find(record.typeId);
+         if (it == publishers_.end())
+         {
+            ++skippedCount_;
+            return;
+         }
+
+         if (Pacing::OriginalTime == pacing)
+         {
+            std::this_thread::sleep_until(start + std::chrono::nanoseconds(record.timestamp));
+         }
+
+         auto * sender = reinterpret_cast<void*>(static_cast<std::uintptr_t>(record.sender));
+         it->second(bus, sender, payload, static_cast<std::size_t>(record.size));
+         ++published;
+      });
+
+      return published;
+   }
+
+} // namespace pcx
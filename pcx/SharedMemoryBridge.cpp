@@ -0,0 +1,338 @@
+#include <pcx/SharedMemoryBridge.h>
+
+#include <atomic>
+#include <climits>
+#include <new>
+#include <thread>
+
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+
+#if defined(__linux__)
+#include <ctime>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace pcx
+{
+   namespace impl
+   {
+      // the ring's atomics are shared between processes, which only works if they
+      // are lock free
+      static_assert(ATOMIC_LLONG_LOCK_FREE == 2 && ATOMIC_INT_LOCK_FREE == 2, "shared memory needs lock free atomics");
+
+      /**
+       * @brief A bounded multi-producer, single-consumer queue of fixed-size slots in
+       * named shared memory. Each slot carries a sequence number saying whether it is
+       * free for the producer at a given position or full for the consumer (after
+       * Dmitry Vyukov's bounded MPMC queue), so producers only contend when reserving
+       * a position and nobody takes a lock.
+       * A sleeping consumer waits on a futex that producers bump after every write
+       * (on Linux; elsewhere it polls).
+       */
+      class SharedRing
+      {
+      public:
+         struct Header
+         {
+            char magic[8];
+            std::uint32_t slotCount;      // a power of two
+            std::uint32_t slotSize;       // including the SlotHeader
+
+            alignas(64) std::atomic<std::uint64_t> enqueuePos;
+            alignas(64) std::atomic<std::uint64_t> dequeuePos;
+            alignas(64) std::atomic<std::uint32_t> wakeCount;
+            std::atomic<std::uint32_t> sleepers;
+         };
+
+         struct SlotHeader
+         {
+            std::atomic<std::uint64_t> sequence;
+            std::uint64_t typeId;
+            std::uint64_t sender;
+            std::uint64_t size;
+         };
+
+         /// Creates the ring, replacing any left behind by a process that crashed
+         SharedRing(std::string const & name, std::size_t slotCount, std::size_t maxMessageSize)
+            : name_(name), owner_(true)
+         {
+            namespace bip = boost::interprocess;
+
+            if (slotCount < 2 || 0 != (slotCount & (slotCount - 1)))
+            {
+               throw std::runtime_error("shared message ring slot count must be a power of two");
+            }
+            auto slotSize = (sizeof(SlotHeader) + maxMessageSize + 63) & ~std::size_t(63);
+
+            try
+            {
+               bip::shared_memory_object::remove(name_.c_str());
+               shm_ = bip::shared_memory_object(bip::create_only, name_.c_str(), bip::read_write);
+               shm_.truncate(sizeof(Header) + slotCount * slotSize);
+               region_ = bip::mapped_region(shm_, bip::read_write);
+            }
+            catch (bip::interprocess_exception const & e)
+            {
+               throw std::runtime_error("could not create shared message ring '" + name_ + "': " + e.what());
+            }
+
+            auto & h = *new (region_.get_address()) Header;
+            h.slotCount = static_cast<std::uint32_t>(slotCount);
+            h.slotSize = static_cast<std::uint32_t>(slotSize);
+            h.enqueuePos.store(0);
+            h.dequeuePos.store(0);
+            h.wakeCount.store(0);
+            h.sleepers.store(0);
+            for (std::size_t i = 0; i < slotCount; ++i)
+            {
+               new (slot(i)) SlotHeader;
+               slot(i)->sequence.store(i);
+            }
+
+            // exporters only accept the ring once the magic is there
+            std::atomic_thread_fence(std::memory_order_release);
+            std::memcpy(h.magic, magic, sizeof(magic));
+         }
+
+         /// Opens a ring created by another SharedRing
+         explicit SharedRing(std::string const & name)
+            : name_(name), owner_(false)
+         {
+            namespace bip = boost::interprocess;
+
+            try
+            {
+               shm_ = bip::shared_memory_object(bip::open_only, name_.c_str(), bip::read_write);
+               region_ = bip::mapped_region(shm_, bip::read_write);
+            }
+            catch (bip::interprocess_exception const & e)
+            {
+               throw std::runtime_error("could not open shared message ring '" + name_ + "': " + e.what());
+            }
+
+            if (region_.get_size() < sizeof(Header)
+               || 0 != std::memcmp(header().magic, magic, sizeof(magic))
+               || region_.get_size() < sizeof(Header) + std::size_t(header().slotCount) * header().slotSize)
+            {
+               throw std::runtime_error("'" + name_ + "' is not a shared message ring");
+            }
+            std::atomic_thread_fence(std::memory_order_acquire);
+         }
+
+         ~SharedRing()
+         {
+            region_ = boost::interprocess::mapped_region();
+            if (owner_) boost::interprocess::shared_memory_object::remove(name_.c_str());
+         }
+
+         std::size_t maxMessageSize() const { return header().slotSize - sizeof(SlotHeader); }
+
+         bool tryWrite(std::uint64_t typeId, std::uint64_t sender, void const * data, std::size_t size)
+         {
+            auto & h = header();
+            auto pos = h.enqueuePos.load(std::memory_order_relaxed);
+
+            SlotHeader * s;
+            for (;;)
+            {
+               s = slot(pos & (h.slotCount - 1));
+               auto seq = s->sequence.load(std::memory_order_acquire);
+               auto diff = static_cast<std::int64_t>(seq - pos);
+               if (0 == diff)
+               {
+                  if (h.enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+               }
+               else if (diff < 0)
+               {
+                  return false;     // the consumer hasn't freed this slot yet
+               }
+               else
+               {
+                  pos = h.enqueuePos.load(std::memory_order_relaxed);
+               }
+            }
+
+            s->typeId = typeId;
+            s->sender = sender;
+            s->size = size;
+            std::memcpy(payload(s), data, size);
+            s->sequence.store(pos + 1, std::memory_order_release);
+
+            h.wakeCount.fetch_add(1);
+            if (h.sleepers.load()) wake(h.wakeCount);
+            return true;
+         }
+
+         /// Calls f(typeId, sender, data, size) for each message waiting, oldest first
+         template <typename F>
+         std::size_t read(F f)
+         {
+            auto & h = header();
+            auto pos = h.dequeuePos.load(std::memory_order_relaxed);
+
+            std::size_t count = 0;
+            for (;; ++pos, ++count)
+            {
+               auto * s = slot(pos & (h.slotCount - 1));
+               if (s->sequence.load(std::memory_order_acquire) != pos + 1) break;
+
+               // the slot is handed back even if f throws
+               struct Release
+               {
+                  ~Release() { s->sequence.store(pos + h.slotCount, std::memory_order_release); h.dequeuePos.store(pos + 1, std::memory_order_relaxed); }
+                  SlotHeader * s;
+                  std::uint64_t pos;
+                  Header & h;
+               } release = { s, pos, h };
+
+               f(s->typeId, s->sender, payload(s), static_cast<std::size_t>(s->size));
+            }
+            return count;
+         }
+
+         bool empty() const
+         {
+            auto & h = header();
+            auto pos = h.dequeuePos.load(std::memory_order_relaxed);
+            return slot(pos & (h.slotCount - 1))->sequence.load(std::memory_order_acquire) != pos + 1;
+         }
+
+         bool wait(std::chrono::milliseconds timeout)
+         {
+            auto & h = header();
+
+            // a write after this makes the futex wait return at once
+            auto seen = h.wakeCount.load();
+            if (!empty()) return true;
+
+            h.sleepers.fetch_add(1);
+            if (empty()) sleep(h.wakeCount, seen, timeout);
+            h.sleepers.fetch_sub(1);
+
+            return !empty();
+         }
+
+      private:
+         SharedRing(SharedRing const &);
+         SharedRing & operator=(SharedRing const &);
+
+         static const char magic[8];
+
+         Header & header() const { return *static_cast<Header*>(region_.get_address()); }
+
+         SlotHeader * slot(std::size_t index) const
+         {
+            auto * base = static_cast<char*>(region_.get_address()) + sizeof(Header);
+            return reinterpret_cast<SlotHeader*>(base + index * header().slotSize);
+         }
+
+         static char * payload(SlotHeader * s) { return reinterpret_cast<char*>(s + 1); }
+
+#if defined(__linux__)
+         static void sleep(std::atomic<std::uint32_t> & word, std::uint32_t seen, std::chrono::milliseconds timeout)
+         {
+            timespec ts;
+            ts.tv_sec = static_cast<time_t>(timeout.count() / 1000);
+            ts.tv_nsec = static_cast<long>((timeout.count() % 1000) * 1000000);
+            syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAIT, seen, &ts, nullptr, 0);
+         }
+
+         static void wake(std::atomic<std::uint32_t> & word)
+         {
+            syscall(SYS_futex, reinterpret_cast<std::uint32_t*>(&word), FUTEX_WAKE, INT_MAX, nullptr, nullptr, 0);
+         }
+#else
+         static void sleep(std::atomic<std::uint32_t> & word, std::uint32_t seen, std::chrono::milliseconds timeout)
+         {
+            auto until = std::chrono::steady_clock::now() + timeout;
+            while (word.load() == seen && std::chrono::steady_clock::now() < until)
+            {
+               std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+         }
+
+         static void wake(std::atomic<std::uint32_t> &)
+         {
+         }
+#endif
+
+         std::string name_;
+         bool owner_;
+         boost::interprocess::shared_memory_object shm_;
+         boost::interprocess::mapped_region region_;
+      };
+
+      const char SharedRing::magic[8] = { 'P', 'C', 'X', 'R', 'I', 'N', 'G', '1' };
+
+   } // namespace impl
+
+   //
+   // MessageBusImporter
+   //
+   //
+
+   MessageBusImporter::MessageBusImporter(std::string const & name, std::size_t slotCount, std::size_t maxMessageSize)
+      : ring_(new impl::SharedRing(name, slotCount, maxMessageSize))
+      , skippedCount_(0)
+   {
+   }
+
+   MessageBusImporter::~MessageBusImporter()
+   {
+   }
+
+   std::size_t MessageBusImporter::poll(MessageBus & bus)
+   {
+      std::size_t published = 0;
+      ring_->read([&](std::uint64_t typeId, std::uint64_t sender, char const * data, std::size_t size)
+      {
+         auto it = publishers_.find(typeId);
+         if (it == publishers_.end() || it->second.first != size)
+         {
+            ++skippedCount_;
+            return;
+         }
+
+         it->second.second(bus, reinterpret_cast<void*>(static_cast<std::uintptr_t>(sender)), data);
+         ++published;
+      });
+      return published;
+   }
+
+   bool MessageBusImporter::wait(std::chrono::milliseconds timeout)
+   {
+      return ring_->wait(timeout);
+   }
+
+   //
+   // MessageBusExporter
+   //
+   //
+
+   MessageBusExporter::MessageBusExporter(std::string const & name)
+      : ring_(new impl::SharedRing(name))
+      , droppedCount_(0)
+   {
+   }
+
+   MessageBusExporter::~MessageBusExporter()
+   {
+   }
+
+   void MessageBusExporter::checkSize(std::size_t size) const
+   {
+      if (size > ring_->maxMessageSize()) throw std::runtime_error("message too large for the shared message ring");
+   }
+
+   bool MessageBusExporter::write(std::uint64_t typeId, void* sender, void const * data, std::size_t size)
+   {
+      if (ring_->tryWrite(typeId, reinterpret_cast<std::uintptr_t>(sender), data, size)) return true;
+
+      ++droppedCount_;
+      return false;
+   }
+
+} // namespace pcx
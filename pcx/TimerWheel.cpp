@@ -0,0 +1,262 @@
+#include <pcx/TimerWheel.h>
+#include <pcx/impl/BitOps.h>
+
+#include <algorithm>
+#include <stdexcept>
+
+namespace pcx
+{
+   //
+   // TimerWheel
+   //
+   //
+
+   const unsigned TimerWheel::LevelBits;
+   const unsigned TimerWheel::SlotsPerLevel;
+   const unsigned TimerWheel::Levels;
+   const unsigned TimerWheel::DueList;
+   const std::uint32_t TimerWheel::npos;
+
+   TimerWheel::TimerWheel(Duration resolution)
+      : resolution_(resolution), now_(0), carry_(Duration::zero()), count_(0), freeNode_(npos)
+   {
+      if (resolution_ <= Duration::zero()) throw std::runtime_error("TimerWheel resolution must be positive");
+
+      std::fill(std::begin(heads_), std::end(heads_), npos);
+      std::fill(std::begin(tails_), std::end(tails_), npos);
+      std::fill(std::begin(occupied_), std::end(occupied_), 0);
+   }
+
+   TimerId TimerWheel::schedule(Duration delay, CallbackT callback)
+   {
+      return add(ticksFrom(delay), 0, std::move(callback));
+   }
+
+   TimerId TimerWheel::scheduleRepeating(Duration delay, Duration interval, CallbackT callback)
+   {
+      // rounded up like a delay from the start of a tick, but never 0 so that a
+      // repeating timer can't fire more than once per tick
+      auto ticks = (std::max(interval, Duration::zero()).count() + resolution_.count() - 1) / resolution_.count();
+      return add(ticksFrom(delay), std::max<std::uint64_t>(ticks, 1), std::move(callback));
+   }
+
+   bool TimerWheel::cancel(TimerId id)
+   {
+      if (!scheduled(id)) return false;
+
+      unlink(id.index);
+      release(id.index);
+      return true;
+   }
+
+   bool TimerWheel::scheduled(TimerId id) const
+   {
+      return id.index < nodes_.size() && nodes_[id.index].generation == id.generation && npos != nodes_[id.index].list;
+   }
+
+   std::size_t TimerWheel::advance(Duration elapsed)
+   {
+      // leftovers from a callback that threw
+      auto fired = fireDue();
+
+      carry_ += std::max(elapsed, Duration::zero());
+      auto ticks = carry_ / resolution_;
+      carry_ -= resolution_ * ticks;
+
+      auto target = now_ + static_cast<std::uint64_t>(ticks);
+      while (now_ < target)
+      {
+         now_ = nextTick(target);
+         if (0 == (now_ & (SlotsPerLevel - 1))) cascade(now_);
+
+         auto slot = static_cast<unsigned>(now_ & (SlotsPerLevel - 1));
+         if (npos == heads_[slot]) continue;
+
+         // everything in a level 0 slot is due on this tick
+         for (auto index = heads_[slot]; npos != index; )
+         {
+            auto next = nodes_[index].next;
+            unlink(index);
+            link(index, DueList);
+            index = next;
+         }
+         fired += fireDue();
+      }
+      return fired;
+   }
+
+   std::uint64_t TimerWheel::ticksFrom(Duration delay) const
+   {
+      // timers are only checked on whole ticks, so round up from the actual time
+      // to avoid firing early
+      auto total = carry_ + std::max(delay, Duration::zero());
+      auto ticks = (total.count() + resolution_.count() - 1) / resolution_.count();
+      return std::max<std::uint64_t>(static_cast<std::uint64_t>(ticks), 1);
+   }
+
+   TimerId TimerWheel::add(std::uint64_t delay, std::uint64_t interval, CallbackT callback)
+   {
+      std::uint32_t index;
+      if (npos != freeNode_)
+      {
+         index = freeNode_;
+         freeNode_ = nodes_[index].next;
+      }
+      else
+      {
+         index = static_cast<std::uint32_t>(nodes_.size());
+         nodes_.push_back(Node{ 0, 0, npos, npos, npos, 0, CallbackT() });
+      }
+
+      auto & node = nodes_[index];
+      node.expiry = now_ + delay;
+      node.interval = interval;
+      node.callback = std::move(callback);
+      ++count_;
+
+      insert(index);
+      return TimerId(index, node.generation);
+   }
+
+   void TimerWheel::release(std::uint32_t index)
+   {
+      auto & node = nodes_[index];
+      node.list = npos;
+      ++node.generation;
+      node.callback = CallbackT();
+      node.next = freeNode_;
+      freeNode_ = index;
+      --count_;
+   }
+
+   void TimerWheel::insert(std::uint32_t index)
+   {
+      auto & node = nodes_[index];
+      auto delta = node.expiry - now_;
+
+      // the level whose slots are just coarse enough that delta lands within
+      // one turn of the wheel
+      unsigned level = 0;
+      while (level + 1 < Levels && delta >= (std::uint64_t(1) << (LevelBits * (level + 1)))) ++level;
+
+      // timers beyond the top level wait in its furthest slot, and are put back
+      // up there each time it comes round until they are in range
+      auto placement = node.expiry;
+      auto const range = (std::uint64_t(1) << (LevelBits * Levels)) - 1;
+      if (delta > range) placement = now_ + range;
+
+      auto slot = static_cast<std::uint32_t>((placement >> (LevelBits * level)) & (SlotsPerLevel - 1));
+      link(index, level * SlotsPerLevel + slot);
+   }
+
+   void TimerWheel::link(std::uint32_t index, std::uint32_t list)
+   {
+      auto & node = nodes_[index];
+      node.list = list;
+      node.prev = tails_[list];
+      node.next = npos;
+
+      if (npos == tails_[list]) heads_[list] = index;
+      else nodes_[tails_[list]].next = index;
+      tails_[list] = index;
+
+      if (list < DueList) occupied_[list / SlotsPerLevel] |= std::uint64_t(1) << (list % SlotsPerLevel);
+   }
+
+   void TimerWheel::unlink(std::uint32_t index)
+   {
+      auto & node = nodes_[index];
+      auto list = node.list;
+
+      if (npos == node.prev) heads_[list] = node.next;
+      else nodes_[node.prev].next = node.next;
+      if (npos == node.next) tails_[list] = node.prev;
+      else nodes_[node.next].prev = node.prev;
+
+      if (list < DueList && npos == heads_[list]) occupied_[list / SlotsPerLevel] &= ~(std::uint64_t(1) << (list % SlotsPerLevel));
+   }
+
+   std::uint64_t TimerWheel::nextTick(std::uint64_t target) const
+   {
+      if (0 == count_) return target;
+
+      // the first tick after now that either has timers due in level 0 or turns a
+      // higher level onto an occupied slot; everything in between can be skipped
+      auto next = target;
+      for (unsigned level = 0; level < Levels; ++level)
+      {
+         if (0 == occupied_[level]) continue;
+
+         auto shift = LevelBits * level;
+         auto first = (now_ >> shift) + 1;
+         auto slot = static_cast<unsigned>(first & (SlotsPerLevel - 1));
+         auto bits = occupied_[level];
+         auto rotated = 0 == slot ? bits : (bits >> slot) | (bits << (SlotsPerLevel - slot));
+
+         auto tick = (first + impl::countTrailingZeros(rotated)) << shift;
+         if (tick < next) next = tick;
+      }
+      return next;
+   }
+
+   void TimerWheel::cascade(std::uint64_t tick)
+   {
+      // redistributes the slot of each level that has come round, highest first
+      for (auto level = Levels - 1; level > 0; --level)
+      {
+         if (0 != (tick & ((std::uint64_t(1) << (LevelBits * level)) - 1))) continue;
+
+         auto list = level * SlotsPerLevel + static_cast<std::uint32_t>((tick >> (LevelBits * level)) & (SlotsPerLevel - 1));
+         auto index = heads_[list];
+         heads_[list] = tails_[list] = npos;
+         occupied_[level] &= ~(std::uint64_t(1) << (list % SlotsPerLevel));
+
+         while (npos != index)
+         {
+            auto next = nodes_[index].next;
+            insert(index);
+            index = next;
+         }
+      }
+   }
+
+   std::size_t TimerWheel::fireDue()
+   {
+      std::size_t fired = 0;
+      while (npos != heads_[DueList])
+      {
+         auto index = heads_[DueList];
+         unlink(index);
+
+         // the callback is moved out as it may schedule timers, moving the nodes
+         CallbackT callback(std::move(nodes_[index].callback));
+         ++fired;
+
+         if (0 == nodes_[index].interval)
+         {
+            release(index);
+            callback();
+            continue;
+         }
+
+         // rescheduled first, so the callback can cancel it
+         auto & node = nodes_[index];
+         auto generation = node.generation;
+         node.expiry = std::max(node.expiry + node.interval, now_ + 1);
+         insert(index);
+
+         try
+         {
+            callback();
+         }
+         catch (...)
+         {
+            if (nodes_[index].generation == generation) nodes_[index].callback = std::move(callback);
+            throw;
+         }
+         if (nodes_[index].generation == generation) nodes_[index].callback = std::move(callback);
+      }
+      return fired;
+   }
+
+} // namespace pcx
@@ -0,0 +1,232 @@
+#include <pcx/WorkerPool.h>
+#include <pcx/Logging.h>
+
+namespace pcx
+{
+   namespace
+   {
+      // the pool the current thread works for, if any, and its place in it
+      thread_local WorkerPool * localPool = nullptr;
+      thread_local std::size_t localWorker = 0;
+   }
+
+   //
+   // WorkerPool
+   //
+   //
+
+   WorkerPool::WorkerPool(std::size_t threadCount)
+      : stopping_(false), queued_(0), sleeping_(0)
+   {
+      if (0 == threadCount) threadCount = 1;
+
+      for (std::size_t i = 0; i < threadCount; ++i) queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+
+      for (std::size_t i = 0; i < threadCount; ++i)
+      {
+         workers_.push_back(std::thread([this, i]() { workerLoop(i); }));
+      }
+   }
+
+   WorkerPool::~WorkerPool()
+   {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         stopping_ = true;
+      }
+      wake_.notify_all();
+
+      for (auto & worker : workers_) worker.join();
+   }
+
+   void WorkerPool::submit(std::function<void()> task)
+   {
+      push(Task{ std::move(task), nullptr });
+   }
+
+   void WorkerPool::push(Task task)
+   {
+      if (localPool == this)
+      {
+         auto & queue = *queues_[localWorker];
+         std::lock_guard<std::mutex> lock(queue.mutex);
+         queue.tasks.push_back(std::move(task));
+      }
+      else
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         tasks_.push_back(std::move(task));
+      }
+
+      // a worker about to sleep either sees the new task or is seen here
+      queued_.fetch_add(1);
+      if (0 == sleeping_.load()) return;
+
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+      }
+      wake_.notify_one();
+   }
+
+   bool WorkerPool::take(Task & task)
+   {
+      if (0 == queued_.load()) return false;
+
+      auto count = queues_.size();
+      auto self = localPool == this ? localWorker : count;
+
+      // the worker's own newest task first, its data is the most likely to be in cache
+      if (self < count)
+      {
+         auto & queue = *queues_[self];
+         std::lock_guard<std::mutex> lock(queue.mutex);
+         if (!queue.tasks.empty())
+         {
+            task = std::move(queue.tasks.back());
+            queue.tasks.pop_back();
+            --queued_;
+            return true;
+         }
+      }
+
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         if (!tasks_.empty())
+         {
+            task = std::move(tasks_.front());
+            tasks_.pop_front();
+            --queued_;
+            return true;
+         }
+      }
+
+      // steal the oldest task of another worker, typically the largest piece of its work
+      for (std::size_t i = 1; i <= count; ++i)
+      {
+         auto & queue = *queues_[(self + i) % count];
+         std::lock_guard<std::mutex> lock(queue.mutex);
+         if (!queue.tasks.empty())
+         {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            --queued_;
+            return true;
+         }
+      }
+
+      return false;
+   }
+
+   bool WorkerPool::tryRunOne()
+   {
+      Task task;
+      if (!take(task)) return false;
+
+      run(task);
+      return true;
+   }
+
+   void WorkerPool::run(Task & task)
+   {
+      std::exception_ptr error;
+      try
+      {
+         task.func();
+      }
+      catch (std::exception & ex)
+      {
+         if (!task.group) LOG(error) << "Unhandled exception in worker task - " << ex.what();
+         error = std::current_exception();
+      }
+      catch (...)
+      {
+         if (!task.group) LOG(error) << "Unhandled exception in worker task";
+         error = std::current_exception();
+      }
+
+      if (task.group) task.group->finished(error);
+   }
+
+   void WorkerPool::workerLoop(std::size_t index)
+   {
+      localPool = this;
+      localWorker = index;
+
+      for (;;)
+      {
+         Task task;
+         if (take(task))
+         {
+            run(task);
+            continue;
+         }
+
+         std::unique_lock<std::mutex> lock(mutex_);
+         ++sleeping_;
+         wake_.wait(lock, [this]() { return stopping_ || 0 != queued_.load(); });
+         --sleeping_;
+
+         // drain the queues before stopping
+         if (stopping_ && 0 == queued_.load()) return;
+      }
+   }
+
+   //
+   // TaskGroup
+   //
+   //
+
+   TaskGroup::TaskGroup(WorkerPool & pool)
+      : pool_(pool), pending_(0)
+   {
+   }
+
+   TaskGroup::~TaskGroup()
+   {
+      // tasks refer to the group, so it can't go away before they finish
+      std::unique_lock<std::mutex> lock(mutex_);
+      done_.wait(lock, [this]() { return 0 == pending_; });
+   }
+
+   void TaskGroup::run(std::function<void()> task)
+   {
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         ++pending_;
+      }
+      pool_.push(WorkerPool::Task{ std::move(task), this });
+   }
+
+   void TaskGroup::wait()
+   {
+      for (;;)
+      {
+         {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (0 == pending_) break;
+         }
+
+         // help out rather than block a thread the group's tasks may need
+         if (pool_.tryRunOne()) continue;
+
+         std::unique_lock<std::mutex> lock(mutex_);
+         done_.wait(lock, [this]() { return 0 == pending_; });
+         break;
+      }
+
+      std::exception_ptr error;
+      {
+         std::lock_guard<std::mutex> lock(mutex_);
+         std::swap(error, error_);
+      }
+      if (error) std::rethrow_exception(error);
+   }
+
+   void TaskGroup::finished(std::exception_ptr error)
+   {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (error && !error_) error_ = error;
+      if (0 == --pending_) done_.notify_all();
+   }
+
+} // namespace pcx
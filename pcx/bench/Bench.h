@@ -0,0 +1,39 @@
+#ifndef PCX_BENCH_H
+#define PCX_BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <string>
+
+namespace bench
+{
+   /// Runs f(iterations) once to warm up and once timed, returning ns per iteration
+   template <typename F>
+   double nsPerOp(std::size_t iterations, F f)
+   {
+      f(iterations / 10 + 1);
+
+      auto start = std::chrono::steady_clock::now();
+      f(iterations);
+      auto elapsed = std::chrono::steady_clock::now() - start;
+
+      return std::chrono::duration<double, std::nano>(elapsed).count() / iterations;
+   }
+
+   inline void report(std::string const & name, double nsPerOp)
+   {
+      std::cout << "  " << std::left << std::setw(48) << name
+                << std::right << std::setw(10) << std::fixed << std::setprecision(2)
+                << nsPerOp << " ns/op" << std::endl;
+   }
+
+   // benchmark suites, one per source file
+   void benchMessageBus();
+   void benchIndexPool();
+   void benchEntityRegistry();
+
+} // namespace bench
+
+#endif // #ifndef PCX_BENCH_H
@@ -0,0 +1,80 @@
+#include "Bench.h"
+
+#include <random>
+#include <vector>
+
+#include <pcx/EntityRegistry.h>
+#include <pcx/IndexPool.h>
+
+namespace
+{
+   struct Position { float x, y; };
+   struct Velocity { float dx, dy; };
+}
+
+namespace bench
+{
+   void benchEntityRegistry()
+   {
+      const long size = 300000;
+      const std::size_t iterations = 20;
+
+      for (auto moving : { size / 2, size / 20 })
+      {
+         std::cout << "EntityRegistry moving " << moving << " of " << size << " entities, per moving entity" << std::endl;
+
+         std::mt19937 random(11);
+         std::vector<char> isMoving(size, 0);
+         for (long placed = 0; placed < moving;)
+         {
+            auto & flag = isMoving[random() % size];
+            if (!flag) { flag = 1; ++placed; }
+         }
+
+         {
+            // the ad-hoc layout, parallel vectors indexed by pool index and a flag per component
+            pcx::IndexPool pool(size);
+            std::vector<Position> positions(size, Position{ 0.0f, 0.0f });
+            std::vector<Velocity> velocities(size, Velocity{ 1.0f, 1.0f });
+            std::vector<char> hasVelocity(size, 0);
+            for (long i = 0; i < size; ++i) hasVelocity[pool.Allocate()] = isMoving[i];
+
+            report("parallel vectors and flags (baseline)", nsPerOp(iterations, [&](std::size_t n)
+            {
+               for (std::size_t i = 0; i < n; ++i)
+               {
+                  pool.ForEach([&](long idx)
+                  {
+                     if (!hasVelocity[idx]) return;
+                     positions[idx].x += velocities[idx].dx;
+                     positions[idx].y += velocities[idx].dy;
+                  });
+               }
+            }) / moving);
+         }
+
+         {
+            pcx::EntityRegistry registry;
+            for (long i = 0; i < size; ++i)
+            {
+               auto entity = registry.create();
+               registry.add<Position>(entity, Position{ 0.0f, 0.0f });
+               if (isMoving[i]) registry.add<Velocity>(entity, Velocity{ 1.0f, 1.0f });
+            }
+
+            report("view<Position, Velocity>", nsPerOp(iterations, [&](std::size_t n)
+            {
+               for (std::size_t i = 0; i < n; ++i)
+               {
+                  registry.view<Position, Velocity>().forEach([](pcx::Entity, Position & position, Velocity & velocity)
+                  {
+                     position.x += velocity.dx;
+                     position.y += velocity.dy;
+                  });
+               }
+            }) / moving);
+         }
+      }
+   }
+
+} // namespace bench
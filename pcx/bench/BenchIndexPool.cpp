@@ -0,0 +1,224 @@
+#include "Bench.h"
+
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <pcx/ConcurrentIndexPool.h>
+#include <pcx/IndexPool.h>
+#include <pcx/WorkerPool.h>
+
+namespace
+{
+   volatile long sink = 0;
+
+   /// Allocates live indices then frees one at random and allocates another, many times over
+   void churn(pcx::IndexPool & pool, long live)
+   {
+      std::vector<long> allocated;
+      while (pool.Size() < live) allocated.push_back(pool.Allocate());
+
+      std::mt19937 random(5);
+      auto take = [&]()
+      {
+         auto pos = random() % allocated.size();
+         auto idx = allocated[pos];
+         allocated[pos] = allocated.back();
+         allocated.pop_back();
+         pool.Free(idx);
+      };
+
+      for (long i = 0; i < pool.Reserved() * 4; ++i)
+      {
+         take();
+         allocated.push_back(pool.Allocate());
+      }
+   }
+
+   void benchWalks(pcx::IndexPool & pool, std::vector<long> const & data, std::size_t iterations)
+   {
+      auto live = static_cast<std::size_t>(pool.Size());
+
+      bench::report("alloc list walk (baseline)", bench::nsPerOp(iterations, [&](std::size_t n)
+      {
+         for (std::size_t i = 0; i < n; ++i)
+         {
+            long total = 0;
+            for (auto idx = pool.First(); -1 != idx; idx = pool.Next(idx)) total += data[idx];
+            sink += total;
+         }
+      }) / live);
+
+      bench::report("ascending bitmap ForEach", bench::nsPerOp(iterations, [&](std::size_t n)
+      {
+         for (std::size_t i = 0; i < n; ++i)
+         {
+            long total = 0;
+            pool.ForEach([&](long idx) { total += data[idx]; });
+            sink += total;
+         }
+      }) / live);
+   }
+
+   /// Each thread allocates a handful of indices and frees them again, n times over
+   template <typename Allocate, typename Free>
+   void churnOnThreads(unsigned threadCount, std::size_t n, Allocate allocate, Free free)
+   {
+      std::vector<std::thread> threads;
+      for (unsigned t = 0; t < threadCount; ++t)
+      {
+         threads.push_back(std::thread([&]()
+         {
+            long held[8];
+            for (std::size_t i = 0; i < n; ++i)
+            {
+               for (auto & idx : held) idx = allocate();
+               for (auto idx : held) free(idx);
+            }
+         }));
+      }
+      for (auto & thread : threads) thread.join();
+   }
+}
+
+namespace bench
+{
+   void benchIndexPool()
+   {
+      const long size = 1 << 20;
+      const std::size_t iterations = 20;
+      std::vector<long> data(size, 1);
+
+      std::cout << "IndexPool visiting " << size / 2 << " of " << size << " indices after churn, per index" << std::endl;
+
+      {
+         pcx::IndexPool pool(size);
+         churn(pool, size / 2);
+         benchWalks(pool, data, iterations);
+      }
+
+      std::cout << "IndexPool visiting " << size / 50 << " of " << size << " indices after churn, per index" << std::endl;
+
+      {
+         // a growable pool, grown to size at some earlier peak
+         pcx::IndexPool pool(0, 1 << 16);
+         std::vector<long> peak(size);
+         pool.Allocate(size, peak);
+         pool.Free(peak);
+
+         churn(pool, size / 50);
+         benchWalks(pool, data, iterations * 10);
+
+         auto start = std::chrono::steady_clock::now();
+         pcx::ApplyRemap(pool.Compact(), data);
+         std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+         pool.Shrink();
+
+         std::cout << "  after Compact (" << elapsed.count() << " ms, with one array) and Shrink to "
+                   << pool.Reserved() << " indices" << std::endl;
+         benchWalks(pool, data, iterations * 10);
+      }
+
+      std::cout << "IndexPool (LowestFree) visiting " << size / 50 << " of " << size << " indices after churn, per index" << std::endl;
+
+      {
+         pcx::IndexPool pool(size, 1 << 16, pcx::AllocationPolicy::LowestFree);
+         churn(pool, size / 50);
+         benchWalks(pool, data, iterations * 10);
+      }
+
+      std::cout << "IndexPool free and allocate at random, " << size / 2 << " of " << size << " allocated" << std::endl;
+
+      for (auto policy : { pcx::AllocationPolicy::Fifo, pcx::AllocationPolicy::LowestFree })
+      {
+         pcx::IndexPool pool(size, policy);
+         std::vector<long> allocated;
+         while (pool.Size() < size / 2) allocated.push_back(pool.Allocate());
+
+         std::mt19937 random(3);
+         report(pcx::AllocationPolicy::Fifo == policy ? "Fifo" : "LowestFree", nsPerOp(iterations * 100000, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+               auto & idx = allocated[random() % allocated.size()];
+               pool.Free(idx);
+               idx = pool.Allocate();
+            }
+         }));
+      }
+
+      const long batchSize = 10000;
+      std::vector<long> batch(batchSize);
+
+      std::cout << "IndexPool spawning and despawning " << batchSize << " indices, per index" << std::endl;
+
+      {
+         pcx::IndexPool pool(size);
+         report("Allocate and Free each", nsPerOp(iterations * 10, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+               for (auto & idx : batch) idx = pool.Allocate();
+               for (auto idx : batch) pool.Free(idx);
+            }
+         }) / batchSize);
+
+         report("batch Allocate and Free", nsPerOp(iterations * 10, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+               pool.Allocate(batchSize, batch);
+               pool.Free(batch);
+            }
+         }) / batchSize);
+      }
+
+      const unsigned threadCount = 4;
+
+      std::cout << "IndexPool allocate and free on " << threadCount << " threads at once, per index" << std::endl;
+      const std::size_t perIteration = threadCount * 8;
+
+      {
+         pcx::IndexPool pool(size);
+         std::mutex mutex;
+         report("IndexPool behind a mutex (baseline)", nsPerOp(iterations * 10000, [&](std::size_t n)
+         {
+            churnOnThreads(threadCount, n,
+               [&]() { std::lock_guard<std::mutex> lock(mutex); return pool.Allocate(); },
+               [&](long idx) { std::lock_guard<std::mutex> lock(mutex); pool.Free(idx); });
+         }) / perIteration);
+      }
+
+      {
+         pcx::ConcurrentIndexPool pool(size);
+         report("ConcurrentIndexPool", nsPerOp(iterations * 10000, [&](std::size_t n)
+         {
+            churnOnThreads(threadCount, n,
+               [&]() { return pool.Allocate(); },
+               [&](long idx) { pool.Free(idx); });
+         }) / perIteration);
+      }
+
+      std::cout << "IndexPool updating " << size / 2 << " of " << size << " indices, per index" << std::endl;
+
+      {
+         pcx::IndexPool pool(size);
+         churn(pool, size / 2);
+         std::vector<double> values(size, 1.0);
+         auto update = [&](long idx) { values[idx] = values[idx] * 0.999 + 0.001; };
+
+         report("ForEach", nsPerOp(iterations, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i) pool.ForEach(update);
+         }) / pool.Size());
+
+         pcx::WorkerPool workers;
+         report("ParallelForEach on " + std::to_string(workers.size()) + " workers", nsPerOp(iterations, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i) pool.ParallelForEach(workers, update);
+         }) / pool.Size());
+      }
+   }
+
+} // namespace bench
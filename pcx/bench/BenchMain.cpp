@@ -0,0 +1,12 @@
+#include "Bench.h"
+
+int main(int argc, char* argv[])
+{
+   (void)argc; (void)argv; // avoid 'unreferenced formal parameter' warnings
+
+   bench::benchMessageBus();
+   bench::benchIndexPool();
+   bench::benchEntityRegistry();
+
+   return 0;
+}
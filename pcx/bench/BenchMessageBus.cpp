@@ -0,0 +1,189 @@
+#include "Bench.h"
+
+#include <functional>
+#include <list>
+#include <typeindex>
+#include <unordered_map>
+#include <vector>
+
+#include <pcx/MessageBus.h>
+
+namespace
+{
+   struct Event1 { int num; };
+   struct Event2 { int num; };
+   struct Event3 { int num; };
+   struct Event4 { int num; };
+
+   volatile long sink = 0;
+
+   // the type_index keyed dispatch MessageBus used before dense type slots,
+   // kept here as the baseline
+   class HashedMessageBus {
+   public:
+      ~HashedMessageBus() {
+         for (auto & entry : publishers_) delete entry.second;
+      }
+
+      template <typename Message>
+      void subscribe(std::function<void(void*,Message const &)> callback) {
+         auto & publisher = publishers_[typeid(Message)];
+         if (!publisher) publisher = new Publisher<Message>{};
+         static_cast<Publisher<Message>*>(publisher)->subscribers.push_back(callback);
+      }
+
+      template <typename Message>
+      void publish(void* sender, Message const & message) {
+         auto it = publishers_.find(typeid(Message));
+         if (it == publishers_.end()) return;
+
+         for (auto & sub : static_cast<Publisher<Message>*>(it->second)->subscribers) sub(sender, message);
+      }
+
+   private:
+      struct PublisherBase { virtual ~PublisherBase() {} };
+
+      template <typename Message>
+      struct Publisher : public PublisherBase {
+         std::list<std::function<void(void*,Message const &)>> subscribers;
+      };
+
+      std::unordered_map<std::type_index, PublisherBase*> publishers_;
+   };
+
+   void subscribeAll(HashedMessageBus & bus)
+   {
+      bus.subscribe<Event1>([](void*, Event1 const & evt) { sink += evt.num; });
+      bus.subscribe<Event2>([](void*, Event2 const & evt) { sink += evt.num; });
+      bus.subscribe<Event3>([](void*, Event3 const & evt) { sink += evt.num; });
+      bus.subscribe<Event4>([](void*, Event4 const & evt) { sink += evt.num; });
+   }
+
+   void subscribeAll(pcx::MessageBus & bus)
+   {
+      bus.subscribe<Event1>([](void*, Event1 const & evt) { sink += evt.num; }).release();
+      bus.subscribe<Event2>([](void*, Event2 const & evt) { sink += evt.num; }).release();
+      bus.subscribe<Event3>([](void*, Event3 const & evt) { sink += evt.num; }).release();
+      bus.subscribe<Event4>([](void*, Event4 const & evt) { sink += evt.num; }).release();
+   }
+}
+
+namespace bench
+{
+   void benchMessageBus()
+   {
+      const std::size_t iterations = 10000000;
+
+      std::cout << "MessageBus publish, 4 types, 1 subscriber each" << std::endl;
+
+      {
+         HashedMessageBus bus;
+         subscribeAll(bus);
+         report("type_index hash lookup (baseline)", nsPerOp(iterations, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i) bus.publish(nullptr, Event3{ 1 });
+         }));
+      }
+
+      {
+         pcx::MessageBus bus;
+         subscribeAll(bus);
+         report("dense type slot", nsPerOp(iterations, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i) bus.publish(nullptr, Event3{ 1 });
+         }));
+
+         auto channel = bus.channel<Event3>();
+         report("Channel<Message>", nsPerOp(iterations, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i) channel.publish(nullptr, Event3{ 1 });
+         }));
+      }
+
+      {
+         HashedMessageBus bus;
+         report("type_index hash lookup, no subscribers", nsPerOp(iterations, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i) bus.publish(nullptr, Event3{ 1 });
+         }));
+      }
+
+      {
+         pcx::MessageBus bus;
+         report("dense type slot, no subscribers", nsPerOp(iterations, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i) bus.publish(nullptr, Event3{ 1 });
+         }));
+      }
+
+      const std::size_t entityCount = 1000;
+      std::vector<int> entities(entityCount);
+
+      std::cout << "MessageBus publish to one of " << entityCount << " entities" << std::endl;
+
+      {
+         pcx::MessageBus bus;
+         std::vector<pcx::Subscription> subscriptions;
+         for (auto & entity : entities)
+         {
+            int * self = &entity;
+            subscriptions.push_back(bus.subscribe<Event1>([self](void* sender, Event1 const & evt)
+            {
+               if (sender == self) sink += evt.num;
+            }));
+         }
+         report("filtered by each subscriber", nsPerOp(iterations / 100, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i) bus.publish(&entities[i % entityCount], Event1{ 1 });
+         }));
+      }
+
+      {
+         pcx::MessageBus bus;
+         std::vector<pcx::Subscription> subscriptions;
+         for (auto & entity : entities)
+         {
+            subscriptions.push_back(bus.subscribe<Event1>(&entity, [](void*, Event1 const & evt)
+            {
+               sink += evt.num;
+            }));
+         }
+         report("sender-filtered subscription", nsPerOp(iterations / 100, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i) bus.publish(&entities[i % entityCount], Event1{ 1 });
+         }));
+      }
+
+      const std::size_t batchSize = 256;
+      std::vector<Event2> batch(batchSize, Event2{ 1 });
+
+      std::cout << "MessageBus delivering " << batchSize << " messages, per message" << std::endl;
+
+      {
+         pcx::MessageBus bus;
+         auto sub = bus.subscribe<Event2>([](void*, Event2 const & evt) { sink += evt.num; });
+         report("publish each", nsPerOp(iterations / batchSize, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i)
+            {
+               for (auto & evt : batch) bus.publish(nullptr, evt);
+            }
+         }) / batchSize);
+      }
+
+      {
+         pcx::MessageBus bus;
+         auto sub = bus.subscribeBatch<Event2>([](void*, pcx::Span<Event2 const> events)
+         {
+            long total = 0;
+            for (auto & evt : events) total += evt.num;
+            sink += total;
+         });
+         report("publishBatch to a batch subscriber", nsPerOp(iterations / batchSize, [&](std::size_t n)
+         {
+            for (std::size_t i = 0; i < n; ++i) bus.publishBatch<Event2>(nullptr, batch);
+         }) / batchSize);
+      }
+   }
+
+} // namespace bench
@@ -0,0 +1,27 @@
+#include <pcx/impl/ComponentStore.h>
+
+namespace pcx
+{
+   namespace impl
+   {
+      const std::uint32_t BaseComponentStore::npos;
+
+      void BaseComponentStore::insertIndex(std::uint32_t index)
+      {
+         if (index >= sparse_.size()) sparse_.resize(index + 1, npos);
+         entities_.push_back(index);
+         sparse_[index] = static_cast<std::uint32_t>(entities_.size() - 1);
+      }
+
+      void BaseComponentStore::removeIndex(std::uint32_t index)
+      {
+         auto position = sparse_[index];
+         auto last = entities_.back();
+         entities_[position] = last;
+         sparse_[last] = position;
+         entities_.pop_back();
+         sparse_[index] = npos;
+      }
+
+   } // namespace impl
+} // namespace pcx
@@ -0,0 +1,147 @@
+#include <pcx/impl/EpochDomain.h>
+
+#include <algorithm>
+#include <limits>
+
+namespace pcx
+{
+   namespace impl
+   {
+      struct EpochDomain::ReaderRecord
+      {
+         ReaderRecord() : epoch(0), inUse(true), depth(0), next(nullptr) { }
+
+         std::atomic<std::uint64_t> epoch; // 0 while the owning thread is quiescent
+         std::atomic<bool> inUse;
+         unsigned depth;                   // only touched by the owning thread
+         ReaderRecord * next;
+
+         // keep each record on its own cache line so readers never share one
+         char padding[64];
+      };
+
+      namespace
+      {
+         // hands the thread's record back to the domain when the thread exits
+         struct LocalReader
+         {
+            LocalReader() : record(nullptr) { }
+            ~LocalReader()
+            {
+               if (record) record->inUse.store(false);
+            }
+
+            EpochDomain::ReaderRecord * record;
+         };
+
+         thread_local LocalReader localReader;
+      }
+
+      //
+      // EpochDomain
+      //
+
+      EpochDomain & EpochDomain::instance()
+      {
+         static EpochDomain domain;
+         return domain;
+      }
+
+      EpochDomain::EpochDomain()
+         : epoch_(1), records_(nullptr)
+      {
+      }
+
+      EpochDomain::ReaderRecord & EpochDomain::localRecord()
+      {
+         if (localReader.record) return *localReader.record;
+
+         // try to reuse a record released by an exited thread
+         for (auto * rec = records_.load(); rec; rec = rec->next)
+         {
+            bool expected = false;
+            if (!rec->inUse.load() && rec->inUse.compare_exchange_strong(expected, true))
+            {
+               localReader.record = rec;
+               return *rec;
+            }
+         }
+
+         auto * rec = new ReaderRecord();
+         auto * head = records_.load();
+         do
+         {
+            rec->next = head;
+         } while (!records_.compare_exchange_weak(head, rec));
+
+         localReader.record = rec;
+         return *rec;
+      }
+
+      void EpochDomain::enter()
+      {
+         auto & rec = localRecord();
+         if (0 == rec.depth++)
+         {
+            // seq_cst so that the pointer loads that follow cannot be ordered
+            // before the epoch becomes visible to writers
+            rec.epoch.store(epoch_.load());
+         }
+      }
+
+      void EpochDomain::leave()
+      {
+         auto & rec = *localReader.record;
+         if (0 == --rec.depth)
+         {
+            rec.epoch.store(0, std::memory_order_release);
+         }
+      }
+
+      std::uint64_t EpochDomain::advance()
+      {
+         return epoch_.fetch_add(1);
+      }
+
+      std::uint64_t EpochDomain::minActiveEpoch() const
+      {
+         auto result = std::numeric_limits<std::uint64_t>::max();
+         for (auto * rec = records_.load(); rec; rec = rec->next)
+         {
+            auto epoch = rec->epoch.load();
+            if (epoch != 0 && epoch < result) result = epoch;
+         }
+         return result;
+      }
+
+      //
+      // RetireList
+      //
+
+      RetireList::~RetireList()
+      {
+         for (auto & entry : retired_) delete entry.second;
+      }
+
+      void RetireList::retire(Retirable * obj)
+      {
+         retired_.push_back(std::make_pair(EpochDomain::instance().advance(), obj));
+      }
+
+      void RetireList::reclaim()
+      {
+         if (retired_.empty()) return;
+
+         auto minEpoch = EpochDomain::instance().minActiveEpoch();
+
+         // a reader in a later epoch than the one an object was retired in
+         // entered after that object was unlinked, so cannot be holding it
+         auto it = std::partition(retired_.begin(), retired_.end(),
+            [=](std::pair<std::uint64_t, Retirable*> const & entry) { return entry.first >= minEpoch; });
+
+         for (auto del = it; del != retired_.end(); ++del) delete del->second;
+         retired_.erase(it, retired_.end());
+      }
+
+   } // namespace impl
+} // namespace pcx
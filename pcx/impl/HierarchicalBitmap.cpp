@@ -0,0 +1,73 @@
+#include <pcx/impl/HierarchicalBitmap.h>
+
+#include <pcx/impl/BitOps.h>
+
+namespace pcx
+{
+   namespace impl
+   {
+      void HierarchicalBitmap::resize(long size)
+      {
+         auto words = static_cast<std::size_t>((size + 63) / 64);
+         if (levels_.empty()) levels_.resize(1);
+
+         auto & bits = levels_[0];
+         bits.resize(words, 0);
+         if (size < size_ && 0 != size % 64) bits.back() &= (std::uint64_t(1) << (size % 64)) - 1;
+         size_ = size;
+
+         // rebuild the levels above, up to a single word
+         std::size_t level = 1;
+         for (; words > 1; ++level)
+         {
+            words = (words + 63) / 64;
+            if (levels_.size() <= level) levels_.resize(level + 1);
+
+            auto & below = levels_[level - 1];
+            auto & above = levels_[level];
+            above.assign(words, 0);
+            for (std::size_t i = 0; i < below.size(); ++i)
+            {
+               if (0 != below[i]) above[i / 64] |= std::uint64_t(1) << (i % 64);
+            }
+         }
+         levels_.resize(level);
+      }
+
+      void HierarchicalBitmap::set(long index)
+      {
+         for (auto & level : levels_)
+         {
+            auto & word = level[index / 64];
+            auto wasEmpty = 0 == word;
+            word |= std::uint64_t(1) << (index % 64);
+            if (!wasEmpty) break;
+            index /= 64;
+         }
+      }
+
+      void HierarchicalBitmap::clear(long index)
+      {
+         for (auto & level : levels_)
+         {
+            auto & word = level[index / 64];
+            word &= ~(std::uint64_t(1) << (index % 64));
+            if (0 != word) break;
+            index /= 64;
+         }
+      }
+
+      long HierarchicalBitmap::lowest() const
+      {
+         if (levels_.empty() || levels_.back().empty() || 0 == levels_.back()[0]) return -1;
+
+         long index = 0;
+         for (auto level = levels_.rbegin(); level != levels_.rend(); ++level)
+         {
+            index = index * 64 + countTrailingZeros((*level)[index]);
+         }
+         return index;
+      }
+
+   } // namespace impl
+} // namespace pcx
@@ -0,0 +1,20 @@
+#include <pcx/impl/MessageTypeSlot.h>
+
+namespace pcx
+{
+   namespace impl
+   {
+      std::uint64_t messageTypeId(char const * typeName)
+      {
+         // FNV-1a
+         std::uint64_t hash = 14695981039346656037ULL;
+         for (; *typeName; ++typeName)
+         {
+            hash ^= static_cast<unsigned char>(*typeName);
+            hash *= 1099511628211ULL;
+         }
+         return hash;
+      }
+
+   } // namespace impl
+} // namespace pcx
@@ -0,0 +1,134 @@
+#include <boost/test/unit_test.hpp>
+using namespace boost::unit_test;
+
+#include <atomic>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+#include <pcx/ConcurrentIndexPool.h>
+
+using namespace pcx;
+
+BOOST_AUTO_TEST_SUITE( ConcurrentIndexPoolSuite )
+
+BOOST_AUTO_TEST_CASE( singleThread )
+{
+   ConcurrentIndexPool pool(100, 2);
+   BOOST_CHECK(100 == pool.Reserved());
+
+   std::set<long> indices;
+   for (int i = 0; i < 100; ++i)
+   {
+      auto idx = pool.Allocate();
+      BOOST_CHECK(idx >= 0 && idx < 100);
+      BOOST_CHECK(indices.insert(idx).second);
+#if PCX_CONCURRENT_INDEX_POOL_CHECKS
+      BOOST_CHECK(pool.IsAllocated(idx));
+#endif
+   }
+   BOOST_CHECK(100 == pool.Size());
+   BOOST_CHECK_THROW(pool.Allocate(), std::runtime_error);
+
+   for (auto idx : indices) pool.Free(idx);
+   BOOST_CHECK(0 == pool.Size());
+#if PCX_CONCURRENT_INDEX_POOL_CHECKS
+   BOOST_CHECK(!pool.IsAllocated(*indices.begin()));
+   BOOST_CHECK_THROW(pool.Free(*indices.begin()), std::runtime_error);
+#endif
+   BOOST_CHECK_THROW(pool.Free(100), std::runtime_error);
+
+   // every index comes back, whether cached in the magazine or on the shared stack
+   indices.clear();
+   for (int i = 0; i < 100; ++i) BOOST_CHECK(indices.insert(pool.Allocate()).second);
+
+   BOOST_CHECK_THROW(ConcurrentIndexPool(0), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE( concurrentChurn )
+{
+   const int threadCount = 8;
+   const int roundsPerThread = 20000;
+   const long size = 1024;
+
+   // fewer magazines than threads, so some threads share one and use the stack
+   ConcurrentIndexPool pool(size, 4);
+   std::vector<std::atomic<int>> owners(size);
+   for (auto & owner : owners) owner = 0;
+
+   std::atomic<long> failures(0);
+   std::mutex handoffMutex;
+   std::vector<long> handoff;
+
+   std::vector<std::thread> threads;
+   for (int t = 0; t < threadCount; ++t)
+   {
+      threads.push_back(std::thread([&, t]()
+      {
+         std::vector<long> held;
+         for (int i = 0; i < roundsPerThread; ++i)
+         {
+            // hold 64 indices, then free a quarter of them and hand another quarter
+            // to be freed by whichever thread empties the handoff next
+            while (held.size() < 64)
+            {
+               auto idx = pool.Allocate();
+               if (0 != owners[idx].exchange(t + 1)) ++failures;
+               held.push_back(idx);
+            }
+
+            std::vector<long> kept;
+            for (std::size_t j = 0; j < held.size(); ++j)
+            {
+               auto idx = held[j];
+               if (1 == j % 2)
+               {
+                  kept.push_back(idx);
+               }
+               else if (0 == j % 4)
+               {
+                  std::lock_guard<std::mutex> lock(handoffMutex);
+                  handoff.push_back(idx);
+               }
+               else
+               {
+                  if (t + 1 != owners[idx].exchange(0)) ++failures;
+                  pool.Free(idx);
+               }
+            }
+            held.swap(kept);
+
+            std::vector<long> others;
+            {
+               std::lock_guard<std::mutex> lock(handoffMutex);
+               others.swap(handoff);
+            }
+            for (auto idx : others)
+            {
+               if (0 == owners[idx].exchange(0)) ++failures;
+               pool.Free(idx);
+            }
+         }
+
+         for (auto idx : held)
+         {
+            if (t + 1 != owners[idx].exchange(0)) ++failures;
+            pool.Free(idx);
+         }
+      }));
+   }
+
+   for (auto & thread : threads) thread.join();
+   for (auto idx : handoff) pool.Free(idx);
+
+   BOOST_CHECK(0 == failures);
+   BOOST_CHECK(0 == pool.Size());
+
+   // nothing was lost, the magazines of the finished threads are drained too
+   std::set<long> indices;
+   for (long i = 0; i < size; ++i) BOOST_CHECK(indices.insert(pool.Allocate()).second);
+   BOOST_CHECK(size == pool.Size());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
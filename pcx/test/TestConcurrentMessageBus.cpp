@@ -0,0 +1,107 @@
+
+#include <boost/test/unit_test.hpp>
+using namespace boost::unit_test;
+
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <pcx/ConcurrentMessageBus.h>
+
+using namespace pcx;
+
+BOOST_AUTO_TEST_SUITE( ConcurrentMessageBusSuite )
+
+BOOST_AUTO_TEST_CASE( basicSubPub )
+{
+   struct Event1 { int num; Event1(int n) : num(n) { } };
+
+   ConcurrentMessageBus bus;
+
+   int calledNum = 0;
+   auto id = bus.subscribe<Event1>([&](void* sender, Event1 const & evt)
+   {
+      calledNum = evt.num;
+   });
+
+   bus.publish<Event1>(nullptr, Event1(10));
+   BOOST_CHECK( calledNum == 10 );
+
+   BOOST_CHECK( bus.unsubscribe<Event1>(id) );
+   BOOST_CHECK( !bus.unsubscribe<Event1>(id) );
+
+   bus.publish<Event1>(nullptr, Event1(20));
+   BOOST_CHECK( calledNum == 10 );
+}
+
+BOOST_AUTO_TEST_CASE( concurrentPublishStress )
+{
+   struct Event1 { int num; };
+   struct Event2 { int num; };
+
+   const int publisherCount = 8;
+   const int publishesPerThread = 20000;
+
+   ConcurrentMessageBus bus;
+
+   std::atomic<long> event1Total(0);
+   std::atomic<long> event2Count(0);
+   bus.subscribe<Event1>([&](void*, Event1 const & evt) { event1Total += evt.num; });
+
+   std::atomic<bool> publishing(true);
+   std::atomic<long> churnCalls(0);
+
+   // keeps replacing the dispatch tables while publishers are running
+   std::thread churn([&]()
+   {
+      while (publishing)
+      {
+         auto id1 = bus.subscribe<Event1>([&](void*, Event1 const &) { ++churnCalls; });
+         auto id2 = bus.subscribe<Event2>([&](void*, Event2 const &) { ++event2Count; });
+         bus.unsubscribe<Event1>(id1);
+         bus.unsubscribe<Event2>(id2);
+      }
+   });
+
+   std::vector<std::thread> publishers;
+   for (int t = 0; t < publisherCount; ++t)
+   {
+      publishers.push_back(std::thread([&]()
+      {
+         for (int i = 0; i < publishesPerThread; ++i)
+         {
+            bus.publish(nullptr, Event1{1});
+            bus.publish(nullptr, Event2{1});
+         }
+      }));
+   }
+
+   for (auto & t : publishers) t.join();
+   publishing = false;
+   churn.join();
+
+   // the permanent subscriber must have seen every message exactly once
+   BOOST_CHECK_EQUAL( event1Total.load(), long(publisherCount) * publishesPerThread );
+   BOOST_CHECK( event2Count.load() <= long(publisherCount) * publishesPerThread );
+}
+
+BOOST_AUTO_TEST_CASE( subscribeFromHandler )
+{
+   struct Event1 { };
+
+   ConcurrentMessageBus bus;
+
+   int nestedCalls = 0;
+   bus.subscribe<Event1>([&](void*, Event1 const &)
+   {
+      // the in-flight publish keeps walking its snapshot
+      bus.subscribe<Event1>([&](void*, Event1 const &) { ++nestedCalls; });
+   });
+
+   bus.publish(nullptr, Event1{});
+   BOOST_CHECK( nestedCalls == 0 );
+
+   bus.publish(nullptr, Event1{});
+   BOOST_CHECK( nestedCalls == 1 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
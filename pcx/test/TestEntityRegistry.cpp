@@ -0,0 +1,159 @@
+#include <boost/test/unit_test.hpp>
+using namespace boost::unit_test;
+
+#include <map>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <pcx/EntityRegistry.h>
+#include <pcx/ServiceRegistry.h>
+
+using namespace pcx;
+
+namespace
+{
+   struct Position { float x, y; };
+   struct Velocity { float dx, dy; };
+   struct Name
+   {
+      Name(std::string value) : value(value) { }
+      std::string value;
+   };
+}
+
+BOOST_AUTO_TEST_SUITE( EntityRegistrySuite )
+
+BOOST_AUTO_TEST_CASE( entitiesAndComponents )
+{
+   EntityRegistry registry;
+
+   auto a = registry.create();
+   auto b = registry.create();
+   BOOST_CHECK(a != b);
+   BOOST_CHECK(2 == registry.size());
+   BOOST_CHECK(registry.isAlive(a));
+
+   registry.add<Position>(a, Position{ 1.0f, 2.0f });
+   registry.add<Name>(a, "a");
+   registry.add<Name>(b, "b");
+   BOOST_CHECK(registry.has<Position>(a));
+   BOOST_CHECK(!registry.has<Position>(b));
+   BOOST_CHECK(!registry.has<Velocity>(a));
+   BOOST_CHECK(2.0f == registry.get<Position>(a).y);
+   BOOST_CHECK("b" == registry.get<Name>(b).value);
+   BOOST_CHECK(nullptr == registry.find<Position>(b));
+   BOOST_CHECK(2 == registry.count<Name>());
+   BOOST_CHECK(0 == registry.count<Velocity>());
+
+   BOOST_CHECK_THROW(registry.add<Name>(a, "again"), std::runtime_error);
+   BOOST_CHECK_THROW(registry.get<Position>(b), std::runtime_error);
+
+   // removing a moves the last component into its place
+   BOOST_CHECK(registry.remove<Name>(a));
+   BOOST_CHECK(!registry.remove<Name>(a));
+   BOOST_CHECK("b" == registry.get<Name>(b).value);
+   BOOST_CHECK(1 == registry.count<Name>());
+
+   // destroying removes every component, and the old handle goes stale
+   BOOST_CHECK(registry.destroy(a));
+   BOOST_CHECK(!registry.destroy(a));
+   BOOST_CHECK(!registry.isAlive(a));
+   BOOST_CHECK(0 == registry.count<Position>());
+   BOOST_CHECK(!registry.has<Position>(a));
+   BOOST_CHECK_THROW(registry.add<Velocity>(a), std::runtime_error);
+   BOOST_CHECK(1 == registry.size());
+
+   BOOST_CHECK(!registry.isAlive(Entity()));
+}
+
+BOOST_AUTO_TEST_CASE( viewIntersectsStores )
+{
+   EntityRegistry registry;
+   std::mt19937 random(29);
+
+   // every entity has a Position, a third a Velocity and a fifth a Name
+   std::map<std::uint32_t, Entity> moving, named, both;
+   for (int i = 0; i < 3000; ++i)
+   {
+      auto entity = registry.create();
+      registry.add<Position>(entity, Position{ static_cast<float>(i), 0.0f });
+      auto move = 0 == random() % 3, name = 0 == random() % 5;
+      if (move) { registry.add<Velocity>(entity, Velocity{ 1.0f, 0.0f }); moving[entity.index] = entity; }
+      if (name) { registry.add<Name>(entity, std::to_string(i)); named[entity.index] = entity; }
+      if (move && name) both[entity.index] = entity;
+   }
+   auto view = registry.view<Position, Velocity>();
+   BOOST_CHECK(static_cast<long>(moving.size()) == view.sizeHint());
+
+   std::map<std::uint32_t, Entity> seen;
+   view.forEach([&](Entity entity, Position & position, Velocity & velocity)
+   {
+      BOOST_CHECK(seen.insert(std::make_pair(entity.index, entity)).second);
+      position.x += velocity.dx;
+   });
+   BOOST_CHECK(moving == seen);
+
+   seen.clear();
+   registry.view<Name, Velocity, Position>().forEach([&](Entity entity, Name & name, Velocity &, Position & position)
+   {
+      BOOST_CHECK(std::to_string(static_cast<int>(position.x) - 1) == name.value);
+      seen[entity.index] = entity;
+   });
+   BOOST_CHECK(both == seen);
+
+   // entities may be destroyed, and their components removed, from inside a view
+   registry.view<Velocity>().forEach([&](Entity entity, Velocity &)
+   {
+      if (named.count(entity.index)) registry.destroy(entity);
+      else registry.remove<Velocity>(entity);
+   });
+   BOOST_CHECK(0 == registry.count<Velocity>());
+   BOOST_CHECK(static_cast<long>(named.size() - both.size()) == registry.count<Name>());
+   BOOST_CHECK(3000 - static_cast<long>(both.size()) == registry.size());
+
+   // a component type nothing has yet makes an empty view
+   struct Unused { };
+   int calls = 0;
+   registry.view<Position, Unused>().forEach([&](Entity, Position &, Unused &) { ++calls; });
+   BOOST_CHECK(0 == calls);
+   BOOST_CHECK(0 == registry.view<Unused>().sizeHint());
+}
+
+BOOST_AUTO_TEST_CASE( entityIndicesAreReused )
+{
+   EntityRegistry registry;
+   std::vector<Entity> entities;
+   for (int i = 0; i < 10000; ++i) entities.push_back(registry.create());
+   for (auto entity : entities) registry.add<Position>(entity, Position{ 0.0f, 0.0f });
+   for (auto entity : entities) registry.destroy(entity);
+
+   // new entities reuse old indices with new generations, and start without components
+   std::map<std::uint32_t, Entity> old;
+   for (auto entity : entities) old[entity.index] = entity;
+   long reused = 0;
+   for (int i = 0; i < 20000; ++i)
+   {
+      auto entity = registry.create();
+      BOOST_CHECK(!registry.has<Position>(entity));
+      auto found = old.find(entity.index);
+      if (old.end() == found) continue;
+      ++reused;
+      BOOST_CHECK(found->second.generation != entity.generation);
+   }
+   BOOST_CHECK(10000 == reused);
+   for (auto entity : entities) BOOST_CHECK(!registry.isAlive(entity));
+}
+
+BOOST_AUTO_TEST_CASE( entityRegistryService )
+{
+   ServiceRegistry services;
+   services.add<EntityRegistry>();
+
+   auto & registry = services.find<EntityRegistry>();
+   auto entity = registry.create();
+   registry.add<Name>(entity, "player");
+   BOOST_CHECK("player" == services.find<EntityRegistry>().get<Name>(entity).value);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,8 +2,16 @@
 #include <boost/test/unit_test.hpp>
 using namespace boost::unit_test;
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
 #include <utility>
+#include <vector>
 #include <pcx/MessageBus.h>
+#include <pcx/WorkerPool.h>
 
 using namespace pcx;
 
@@ -17,7 +25,7 @@ BOOST_AUTO_TEST_CASE( basicSubPub )
 
    bool called = false;
    int calledNum = 0;
-   bus.subscribe<Event1>([&](void* sender, Event1 const & evt)
+   auto subscription = bus.subscribe<Event1>([&](void* sender, Event1 const & evt)
    {
       called = true;
       calledNum = evt.num;
@@ -30,4 +38,843 @@ BOOST_AUTO_TEST_CASE( basicSubPub )
    BOOST_CHECK( calledNum == 10 );
 }
 
+BOOST_AUTO_TEST_CASE( queuedDelivery )
+{
+   struct Event1 { int num; Event1(int n) : num(n) { } };
+   struct Event2 { };
+
+   MessageBus bus;
+
+   std::vector<int> received;
+   int event2Count = 0;
+   auto sub1 = bus.subscribe<Event1>([&](void*, Event1 const & evt) { received.push_back(evt.num); });
+   auto sub2 = bus.subscribe<Event2>([&](void*, Event2 const &) { ++event2Count; });
+
+   bus.enqueue(nullptr, Event1(1));
+   bus.enqueue(nullptr, Event2());
+   bus.enqueue(nullptr, Event1(2));
+   BOOST_CHECK( received.empty() );
+
+   BOOST_CHECK( bus.dispatchPending() == 3 );
+   BOOST_CHECK( received == std::vector<int>({ 1, 2 }) );
+   BOOST_CHECK( event2Count == 1 );
+
+   BOOST_CHECK( bus.dispatchPending() == 0 );
+}
+
+BOOST_AUTO_TEST_CASE( enqueueDuringDispatch )
+{
+   struct Event1 { int num; Event1(int n) : num(n) { } };
+
+   MessageBus bus;
+
+   std::vector<int> received;
+   auto subscription = bus.subscribe<Event1>([&](void* sender, Event1 const & evt)
+   {
+      received.push_back(evt.num);
+      if (evt.num < 3) bus.enqueue(sender, Event1(evt.num + 1));
+   });
+
+   bus.enqueue(nullptr, Event1(1));
+
+   // each drain only delivers what was queued before it started
+   BOOST_CHECK( bus.dispatchPending() == 1 );
+   BOOST_CHECK( received == std::vector<int>({ 1 }) );
+   BOOST_CHECK( bus.dispatchPending() == 1 );
+   BOOST_CHECK( bus.dispatchPending() == 1 );
+   BOOST_CHECK( bus.dispatchPending() == 0 );
+   BOOST_CHECK( received == std::vector<int>({ 1, 2, 3 }) );
+}
+
+BOOST_AUTO_TEST_CASE( enqueueOtherTypeDuringDispatch )
+{
+   struct Event1 { int num; Event1(int n) : num(n) { } };
+   struct Event2 { int num; Event2(int n) : num(n) { } };
+   struct Event3 { int num; Event3(int n) : num(n) { } };
+
+   MessageBus bus;
+   bus.setQueueCapacity<Event3>(10, OverflowPolicy::Fail);
+
+   std::vector<int> received;
+   auto sub1 = bus.subscribe<Event1>([&](void* sender, Event1 const & evt)
+   {
+      received.push_back(evt.num);
+      bus.enqueue(sender, Event1(evt.num + 10));
+      bus.enqueue(sender, Event2(evt.num + 20));
+      bus.enqueue(sender, Event3(evt.num + 30));
+   });
+   auto sub2 = bus.subscribe<Event2>([&](void*, Event2 const & evt) { received.push_back(evt.num); });
+   auto sub3 = bus.subscribe<Event3>([&](void*, Event3 const & evt) { received.push_back(evt.num); });
+
+   // Event1 is drained first, while Event2 and Event3 (bounded) already have messages queued
+   bus.enqueue(nullptr, Event1(1));
+   bus.enqueue(nullptr, Event2(2));
+   bus.enqueue(nullptr, Event3(3));
+
+   // the messages enqueued by the handler wait for the next call, whatever their type
+   BOOST_CHECK( bus.dispatchPending() == 3 );
+   BOOST_CHECK( received == std::vector<int>({ 1, 2, 3 }) );
+   BOOST_CHECK( bus.dispatchPending() == 3 );
+   BOOST_CHECK( received == std::vector<int>({ 1, 2, 3, 11, 21, 31 }) );
+}
+
+BOOST_AUTO_TEST_CASE( channelPublish )
+{
+   struct Event1 { int num; Event1(int n) : num(n) { } };
+
+   MessageBus bus;
+
+   // channels may be created before anyone subscribes
+   auto channel = bus.channel<Event1>();
+
+   int total = 0;
+   auto subscription = bus.subscribe<Event1>([&](void*, Event1 const & evt) { total += evt.num; });
+
+   channel.publish(nullptr, Event1(1));
+   BOOST_CHECK( total == 1 );
+
+   channel.enqueue(nullptr, Event1(2));
+   BOOST_CHECK( total == 1 );
+   bus.dispatchPending();
+   BOOST_CHECK( total == 3 );
+
+   bus.publish(nullptr, Event1(4));
+   BOOST_CHECK( total == 7 );
+}
+
+BOOST_AUTO_TEST_CASE( unsubscribeTokens )
+{
+   struct Event1 { };
+
+   MessageBus bus;
+
+   std::vector<int> calls(4, 0);
+   std::vector<Subscription> subscriptions;
+   for (int i = 0; i < 4; ++i)
+   {
+      subscriptions.push_back(bus.subscribe<Event1>([&calls, i](void*, Event1 const &) { ++calls[i]; }));
+   }
+
+   bus.publish(nullptr, Event1());
+   BOOST_CHECK( calls == std::vector<int>({ 1, 1, 1, 1 }) );
+
+   // removing from the middle swaps the last subscriber into its place,
+   // the other tokens must still refer to the right subscribers
+   subscriptions[1].reset();
+   bus.publish(nullptr, Event1());
+   BOOST_CHECK( calls == std::vector<int>({ 2, 1, 2, 2 }) );
+
+   subscriptions[3].reset();
+   subscriptions[3].reset();
+   subscriptions[0] = Subscription();
+   bus.publish(nullptr, Event1());
+   BOOST_CHECK( calls == std::vector<int>({ 2, 1, 3, 2 }) );
+
+   // handles are reused for new subscribers without reviving old tokens
+   auto replacement = bus.subscribe<Event1>([&](void*, Event1 const &) { ++calls[0]; });
+   bus.publish(nullptr, Event1());
+   BOOST_CHECK( calls == std::vector<int>({ 3, 1, 4, 2 }) );
+
+   {
+      auto moved = std::move(subscriptions[2]);
+      BOOST_CHECK( !subscriptions[2].active() );
+   }
+   bus.publish(nullptr, Event1());
+   BOOST_CHECK( calls == std::vector<int>({ 4, 1, 4, 2 }) );
+
+   replacement.release();
+   bus.publish(nullptr, Event1());
+   BOOST_CHECK( calls == std::vector<int>({ 5, 1, 4, 2 }) );
+}
+
+BOOST_AUTO_TEST_CASE( memberFunctionSubscriber )
+{
+   struct Event1 { int num; Event1(int n) : num(n) { } };
+
+   struct Listener
+   {
+      int total = 0;
+      void onEvent(void*, Event1 const & evt) { total += evt.num; }
+   };
+
+   MessageBus bus;
+   Listener listener;
+
+   {
+      auto subscription = bus.subscribe<Event1, Listener, &Listener::onEvent>(listener);
+      bus.publish(nullptr, Event1(3));
+      bus.publish(nullptr, Event1(4));
+   }
+   bus.publish(nullptr, Event1(5));
+
+   BOOST_CHECK( listener.total == 7 );
+}
+
+BOOST_AUTO_TEST_CASE( largeCallback )
+{
+   struct Event1 { };
+
+   MessageBus bus;
+
+   // too big to be stored inline, falls back to the heap
+   std::vector<int> values(16, 1);
+   int total = 0;
+   auto subscription = bus.subscribe<Event1>([values, &total](void*, Event1 const &)
+   {
+      for (auto v : values) total += v;
+   });
+
+   bus.publish(nullptr, Event1());
+   BOOST_CHECK( total == 16 );
+}
+
+BOOST_AUTO_TEST_CASE( senderFilteredSubscribers )
+{
+   struct Event1 { };
+
+   MessageBus bus;
+
+   int entities[3];
+   std::vector<int> calls(3, 0);
+   int anyCalls = 0;
+   std::vector<void*> order;
+
+   auto any = bus.subscribe<Event1>([&](void* sender, Event1 const &) { ++anyCalls; order.push_back(nullptr); });
+   auto sub0 = bus.subscribe<Event1>(&entities[0], [&](void* sender, Event1 const &)
+   {
+      BOOST_CHECK( sender == &entities[0] );
+      ++calls[0];
+      order.push_back(sender);
+   });
+   auto sub1 = bus.subscribe<Event1>(&entities[1], [&](void*, Event1 const &) { ++calls[1]; });
+   auto sub1b = bus.subscribe<Event1>(&entities[1], [&](void*, Event1 const &) { ++calls[1]; });
+
+   bus.publish(&entities[0], Event1());
+   BOOST_CHECK( calls == std::vector<int>({ 1, 0, 0 }) );
+   BOOST_CHECK( anyCalls == 1 );
+   // wildcard subscribers come first
+   BOOST_CHECK( order == std::vector<void*>({ nullptr, &entities[0] }) );
+
+   bus.publish(&entities[1], Event1());
+   bus.publish(&entities[2], Event1());
+   BOOST_CHECK( calls == std::vector<int>({ 1, 2, 0 }) );
+   BOOST_CHECK( anyCalls == 3 );
+
+   sub1.reset();
+   bus.publish(&entities[1], Event1());
+   BOOST_CHECK( calls == std::vector<int>({ 1, 3, 0 }) );
+
+   sub1b.reset();
+   sub0.reset();
+   bus.publish(&entities[0], Event1());
+   bus.publish(&entities[1], Event1());
+   BOOST_CHECK( calls == std::vector<int>({ 1, 3, 0 }) );
+   BOOST_CHECK( anyCalls == 6 );
+
+   // sender lists are recreated on demand
+   auto sub2 = bus.subscribe<Event1>(&entities[1], [&](void*, Event1 const &) { ++calls[1]; });
+   bus.enqueue(&entities[1], Event1());
+   bus.dispatchPending();
+   BOOST_CHECK( calls == std::vector<int>({ 1, 4, 0 }) );
+}
+
+BOOST_AUTO_TEST_CASE( parallelSubscribers )
+{
+   struct Event1 { int num; Event1(int n) : num(n) { } };
+
+   std::atomic<int> joinTotal(0);
+   std::atomic<int> detachedTotal(0);
+   std::vector<int> inlineOrder;
+
+   {
+      WorkerPool pool(4);
+      MessageBus bus;
+      bus.setWorkerPool(&pool);
+
+      std::vector<Subscription> subscriptions;
+      for (int i = 0; i < 8; ++i)
+      {
+         subscriptions.push_back(bus.subscribe<Event1>([&](void*, Event1 const & evt)
+         {
+            joinTotal += evt.num;
+         }, DispatchPolicy::ParallelJoin));
+      }
+      subscriptions.push_back(bus.subscribe<Event1>([&](void*, Event1 const & evt)
+      {
+         detachedTotal += evt.num;
+      }, DispatchPolicy::ParallelDetached));
+
+      for (int i = 0; i < 3; ++i)
+      {
+         subscriptions.push_back(bus.subscribe<Event1>([&inlineOrder, i](void*, Event1 const &)
+         {
+            inlineOrder.push_back(i);
+         }));
+      }
+
+      bus.publish(nullptr, Event1(1));
+
+      // fork-join subscribers have all finished by the time publish returns
+      BOOST_CHECK( joinTotal == 8 );
+      BOOST_CHECK( inlineOrder == std::vector<int>({ 0, 1, 2 }) );
+
+      bus.publish(nullptr, Event1(2));
+      BOOST_CHECK( joinTotal == 24 );
+      BOOST_CHECK( inlineOrder == std::vector<int>({ 0, 1, 2, 0, 1, 2 }) );
+
+      // the pool finishes detached tasks before it goes away
+   }
+   BOOST_CHECK( detachedTotal == 3 );
+}
+
+BOOST_AUTO_TEST_CASE( parallelSubscribersWithoutPool )
+{
+   struct Event1 { };
+
+   MessageBus bus;
+
+   std::vector<int> order;
+   auto sub1 = bus.subscribe<Event1>([&](void*, Event1 const &) { order.push_back(1); }, DispatchPolicy::ParallelJoin);
+   auto sub2 = bus.subscribe<Event1>([&](void*, Event1 const &) { order.push_back(2); });
+
+   bus.publish(nullptr, Event1());
+   BOOST_CHECK( order == std::vector<int>({ 2, 1 }) );
+}
+
+BOOST_AUTO_TEST_CASE( parallelSubscriberExceptions )
+{
+   struct Event1 { };
+
+   WorkerPool pool(2);
+   MessageBus bus;
+   bus.setWorkerPool(&pool);
+
+   auto sub = bus.subscribe<Event1>([&](void*, Event1 const &) { throw std::runtime_error("oops"); }, DispatchPolicy::ParallelJoin);
+
+   BOOST_CHECK_THROW( bus.publish(nullptr, Event1()), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_CASE( conflatingMessages )
+{
+   struct Position { int x; Position(int x) : x(x) { } };
+
+   MessageBus bus;
+   bus.setConflating<Position>();
+
+   int entities[2];
+   std::vector<std::pair<void*, int>> received;
+   auto subscription = bus.subscribe<Position>([&](void* sender, Position const & pos)
+   {
+      received.push_back(std::make_pair(sender, pos.x));
+   });
+
+   for (int i = 0; i < 100; ++i)
+   {
+      bus.enqueue(&entities[0], Position(i));
+      bus.enqueue(&entities[1], Position(-i));
+   }
+
+   // one message per sender, latest value, first-enqueued position
+   BOOST_CHECK( bus.dispatchPending() == 2 );
+   BOOST_REQUIRE( received.size() == 2 );
+   BOOST_CHECK( received[0] == std::make_pair((void*)&entities[0], 99) );
+   BOOST_CHECK( received[1] == std::make_pair((void*)&entities[1], -99) );
+
+   // direct publishes are never conflated
+   bus.publish(&entities[0], Position(1));
+   bus.publish(&entities[0], Position(2));
+   BOOST_CHECK( received.size() == 4 );
+
+   bus.setConflating<Position>(false);
+   bus.enqueue(&entities[0], Position(1));
+   bus.enqueue(&entities[0], Position(2));
+   BOOST_CHECK( bus.dispatchPending() == 2 );
+}
+
+BOOST_AUTO_TEST_CASE( dispatchMetrics )
+{
+   struct MetricsEvent { };
+
+   MessageBus bus;
+
+   auto sub1 = bus.subscribe<MetricsEvent>([](void*, MetricsEvent const &) { });
+   auto sub2 = bus.subscribe<MetricsEvent>(&bus, [](void*, MetricsEvent const &) { });
+   bus.setSubscriberTiming<MetricsEvent>(true);
+
+   for (int i = 0; i < 10; ++i) bus.publish(nullptr, MetricsEvent());
+   bus.enqueue(&bus, MetricsEvent());
+   bus.dispatchPending();
+
+   auto metrics = bus.metrics();
+
+#if PCX_MESSAGE_BUS_METRICS
+   BOOST_REQUIRE( metrics.size() == 1 );
+   auto & m = metrics.front();
+   BOOST_CHECK( m.name.find("MetricsEvent") != std::string::npos );
+   BOOST_CHECK( m.publishCount == 11 );
+   BOOST_CHECK( m.subscriberCount == 2 );
+   BOOST_CHECK( m.maxDispatchTime <= m.totalDispatchTime );
+
+   BOOST_REQUIRE( m.subscribers.size() == 2 );
+   BOOST_CHECK( m.subscribers[0].latency.count() == 11 );
+   BOOST_CHECK( m.subscribers[1].latency.count() == 1 );
+
+   std::ostringstream out;
+   writeMetrics(out, metrics);
+   BOOST_CHECK( out.str().find("MetricsEvent") != std::string::npos );
+
+   bus.resetMetrics();
+   BOOST_CHECK( bus.metrics().front().publishCount == 0 );
+#else
+   BOOST_CHECK( metrics.empty() );
+#endif
+}
+
+BOOST_AUTO_TEST_CASE( metricsDuringDispatch )
+{
+   struct MetricsEvent { };
+
+   MessageBus bus;
+   bus.setSubscriberTiming<MetricsEvent>(true);
+
+   std::vector<MessageTypeMetrics> metrics;
+   Subscription sub2;
+   auto sub1 = bus.subscribe<MetricsEvent>([&](void*, MetricsEvent const &) {
+      // sub2 stays in its list, unsubscribed, until the publish ends
+      sub2.reset();
+      metrics = bus.metrics();
+   });
+   sub2 = bus.subscribe<MetricsEvent>([](void*, MetricsEvent const &) { });
+
+   bus.publish(nullptr, MetricsEvent());
+
+#if PCX_MESSAGE_BUS_METRICS
+   BOOST_REQUIRE( metrics.size() == 1 );
+   BOOST_CHECK( metrics.front().subscriberCount == 1 );
+   BOOST_CHECK( metrics.front().subscribers.size() == 1 );
+#else
+   BOOST_CHECK( metrics.empty() );
+#endif
+}
+
+BOOST_AUTO_TEST_CASE( boundedQueues )
+{
+   struct Event1 { int num; Event1(int n) : num(n) { } };
+   struct Event2 { int num; Event2(int n) : num(n) { } };
+   struct Event3 { int num; Event3(int n) : num(n) { } };
+
+   MessageBus bus;
+   bus.setQueueCapacity<Event1>(3, OverflowPolicy::DropNewest);
+   bus.setQueueCapacity<Event2>(3, OverflowPolicy::DropOldest);
+   bus.setQueueCapacity<Event3>(3, OverflowPolicy::Fail);
+
+   std::vector<int> received1, received2, received3;
+   auto sub1 = bus.subscribe<Event1>([&](void*, Event1 const & evt) { received1.push_back(evt.num); });
+   auto sub2 = bus.subscribe<Event2>([&](void*, Event2 const & evt) { received2.push_back(evt.num); });
+   auto sub3 = bus.subscribe<Event3>([&](void*, Event3 const & evt) { received3.push_back(evt.num); });
+
+   for (int i = 0; i < 5; ++i)
+   {
+      auto result = bus.enqueue(nullptr, Event1(i));
+      BOOST_CHECK( result == (i < 3 ? EnqueueResult::Queued : EnqueueResult::Dropped) );
+      BOOST_CHECK( bus.enqueue(nullptr, Event2(i)) == EnqueueResult::Queued );
+      result = bus.enqueue(nullptr, Event3(i));
+      BOOST_CHECK( result == (i < 3 ? EnqueueResult::Queued : EnqueueResult::Rejected) );
+   }
+
+   auto stats = bus.queueStats<Event2>();
+   BOOST_CHECK( stats.pending == 3 );
+   BOOST_CHECK( stats.dropped == 2 );
+   BOOST_CHECK( bus.queueStats<Event3>().dropped == 2 );
+
+   BOOST_CHECK( bus.dispatchPending() == 9 );
+   BOOST_CHECK( received1 == std::vector<int>({ 0, 1, 2 }) );
+   BOOST_CHECK( received2 == std::vector<int>({ 2, 3, 4 }) );
+   BOOST_CHECK( received3 == std::vector<int>({ 0, 1, 2 }) );
+
+   // the queue has room again
+   BOOST_CHECK( bus.enqueue(nullptr, Event3(5)) == EnqueueResult::Queued );
+   BOOST_CHECK( bus.dispatchPending() == 1 );
+   BOOST_CHECK( bus.queueStats<Event3>().pending == 0 );
+}
+
+BOOST_AUTO_TEST_CASE( raiseCapacityAfterDropOldest )
+{
+   struct Event1 { int num; Event1(int n) : num(n) { } };
+
+   MessageBus bus;
+   bus.setQueueCapacity<Event1>(3, OverflowPolicy::DropOldest);
+
+   std::vector<int> received;
+   auto sub = bus.subscribe<Event1>([&](void*, Event1 const & evt) { received.push_back(evt.num); });
+
+   // the full queue wraps around, then has room again once the capacity is raised
+   for (int i = 1; i <= 5; ++i) bus.enqueue(nullptr, Event1(i));
+   bus.setQueueCapacity<Event1>(10, OverflowPolicy::DropOldest);
+   bus.enqueue(nullptr, Event1(6));
+
+   BOOST_CHECK( bus.dispatchPending() == 4 );
+   BOOST_CHECK( received == std::vector<int>({ 3, 4, 5, 6 }) );
+
+   // a conflating queue still finds each sender's message once unwound
+   bus.setConflating<Event1>();
+   bus.setQueueCapacity<Event1>(2, OverflowPolicy::DropOldest);
+   int senders[3];
+   for (int i = 0; i < 3; ++i) bus.enqueue(&senders[i], Event1(10 + i));
+   bus.setQueueCapacity<Event1>(10, OverflowPolicy::DropOldest);
+   bus.enqueue(&senders[1], Event1(21));
+   bus.enqueue(&senders[0], Event1(20));
+
+   received.clear();
+   BOOST_CHECK( bus.dispatchPending() == 3 );
+   BOOST_CHECK( received == std::vector<int>({ 21, 12, 20 }) );
+}
+
+BOOST_AUTO_TEST_CASE( boundedConflatingQueue )
+{
+   struct Position { int x; Position(int x) : x(x) { } };
+
+   MessageBus bus;
+   bus.setConflating<Position>();
+   bus.setQueueCapacity<Position>(2, OverflowPolicy::DropOldest);
+
+   int entities[3];
+   std::vector<std::pair<void*, int>> received;
+   auto subscription = bus.subscribe<Position>([&](void* sender, Position const & pos)
+   {
+      received.push_back(std::make_pair(sender, pos.x));
+   });
+
+   bus.enqueue(&entities[0], Position(1));
+   bus.enqueue(&entities[1], Position(2));
+   // replacing a pending message never overflows
+   bus.enqueue(&entities[0], Position(3));
+   BOOST_CHECK( bus.queueStats<Position>().dropped == 0 );
+
+   // overwrites entities[0], and the new position must still conflate
+   bus.enqueue(&entities[2], Position(4));
+   bus.enqueue(&entities[2], Position(5));
+   BOOST_CHECK( bus.queueStats<Position>().dropped == 1 );
+
+   BOOST_CHECK( bus.dispatchPending() == 2 );
+   BOOST_REQUIRE( received.size() == 2 );
+   BOOST_CHECK( received[0] == std::make_pair((void*)&entities[1], 2) );
+   BOOST_CHECK( received[1] == std::make_pair((void*)&entities[2], 5) );
+}
+
+BOOST_AUTO_TEST_CASE( setConflatingWhileEnqueueing )
+{
+   struct Event1 { int num; Event1(int n) : num(n) { } };
+
+   MessageBus bus;
+   bus.setQueueCapacity<Event1>(64, OverflowPolicy::DropNewest);
+   auto channel = bus.channel<Event1>();
+
+   std::size_t received = 0;
+   auto subscription = bus.subscribe<Event1>([&](void*, Event1 const &) { ++received; });
+
+   const int count = 20000;
+   int senders[4];
+   std::atomic<bool> done(false);
+   std::thread producer([&]()
+   {
+      for (int i = 0; i < count; ++i) channel.enqueue(&senders[i % 4], Event1(i));
+      done = true;
+   });
+
+   // the conflating index is rebuilt under the queue's lock, so producers never see it half built
+   for (int i = 0; !done; ++i)
+   {
+      bus.setConflating<Event1>(0 == i % 2);
+      bus.dispatchPending();
+   }
+   producer.join();
+   bus.dispatchPending();
+
+   BOOST_CHECK( received + bus.queueStats<Event1>().dropped <= count );
+   BOOST_CHECK( 0 < received );
+}
+
+BOOST_AUTO_TEST_CASE( blockingQueue )
+{
+   struct Event1 { int num; Event1(int n) : num(n) { } };
+
+   MessageBus bus;
+   bus.setQueueCapacity<Event1>(4, OverflowPolicy::Block);
+   auto channel = bus.channel<Event1>();
+
+   std::vector<int> received;
+   auto subscription = bus.subscribe<Event1>([&](void*, Event1 const & evt) { received.push_back(evt.num); });
+
+   const int count = 1000;
+   std::thread producer([&]()
+   {
+      for (int i = 0; i < count; ++i) channel.enqueue(nullptr, Event1(i));
+   });
+
+   while (received.size() < count)
+   {
+      BOOST_REQUIRE( bus.dispatchPending() <= 4 );
+      std::this_thread::yield();
+   }
+   producer.join();
+
+   BOOST_REQUIRE( received.size() == count );
+   for (int i = 0; i < count; ++i) BOOST_REQUIRE( received[i] == i );
+   BOOST_CHECK( bus.queueStats<Event1>().dropped == 0 );
+
+   // blocking the thread that drains the queue would never return
+   for (int i = 0; i < 4; ++i) bus.enqueue(nullptr, Event1(i));
+   BOOST_CHECK_THROW( bus.enqueue(nullptr, Event1(4)), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_CASE( subscribeDuringNestedPublish )
+{
+   struct Event1 { int depth; Event1(int d) : depth(d) { } };
+
+   MessageBus bus;
+
+   std::vector<int> calls;
+   std::vector<Subscription> added;
+   auto subscription = bus.subscribe<Event1>([&](void*, Event1 const & evt)
+   {
+      calls.push_back(evt.depth);
+      if (evt.depth == 0)
+      {
+         // many subscribers, so that an immediate add would have to reallocate the list
+         for (int i = 0; i < 16; ++i)
+         {
+            added.push_back(bus.subscribe<Event1>([&](void*, Event1 const & e) { calls.push_back(100 + e.depth); }));
+         }
+      }
+      if (evt.depth < 2) bus.publish(nullptr, Event1(evt.depth + 1));
+   });
+
+   bus.publish(nullptr, Event1(0));
+   // the new subscribers miss the nested publishes too
+   BOOST_CHECK( calls == std::vector<int>({ 0, 1, 2 }) );
+
+   calls.clear();
+   bus.publish(nullptr, Event1(5));
+   BOOST_CHECK( calls.size() == 17 );
+   BOOST_CHECK( calls.front() == 5 );
+   BOOST_CHECK( calls.back() == 105 );
+
+   // unsubscribing before they were added
+   calls.clear();
+   added.clear();
+   std::vector<Subscription> cancelled;
+   auto sub2 = bus.subscribe<Event1>([&](void*, Event1 const & evt)
+   {
+      if (evt.depth != 10) return;
+      cancelled.push_back(bus.subscribe<Event1>([&](void*, Event1 const &) { calls.push_back(-1); }));
+      cancelled.clear();
+   });
+   bus.publish(nullptr, Event1(10));
+   bus.publish(nullptr, Event1(11));
+   BOOST_CHECK( calls == std::vector<int>({ 10, 11 }) );
+}
+
+BOOST_AUTO_TEST_CASE( unsubscribeDuringNestedPublish )
+{
+   struct Event1 { int depth; Event1(int d) : depth(d) { } };
+
+   MessageBus bus;
+
+   std::vector<int> calls;
+   Subscription subs[4];
+   for (int i = 0; i < 4; ++i)
+   {
+      subs[i] = bus.subscribe<Event1>([&, i](void*, Event1 const & evt)
+      {
+         calls.push_back(i);
+         if (i == 1 && evt.depth == 0)
+         {
+            // itself, one already called and one still to come
+            subs[1].reset();
+            subs[0].reset();
+            subs[3].reset();
+            bus.publish(nullptr, Event1(1));
+         }
+      });
+   }
+
+   bus.publish(nullptr, Event1(0));
+   BOOST_CHECK( calls == std::vector<int>({ 0, 1, 2, 2 }) );
+
+   // the remaining subscriber is still found through its token
+   calls.clear();
+   bus.publish(nullptr, Event1(2));
+   BOOST_CHECK( calls == std::vector<int>({ 2 }) );
+   subs[2].reset();
+   bus.publish(nullptr, Event1(2));
+   BOOST_CHECK( calls == std::vector<int>({ 2 }) );
+}
+
+BOOST_AUTO_TEST_CASE( unsubscribeSenderDuringDispatch )
+{
+   struct Event1 { };
+
+   MessageBus bus;
+   int entity;
+
+   int calls = 0;
+   Subscription sub;
+   sub = bus.subscribe<Event1>(&entity, [&](void* sender, Event1 const &)
+   {
+      ++calls;
+      // empties the sender's list while it is being walked
+      sub.reset();
+      bus.publish(sender, Event1());
+   });
+
+   bus.publish(&entity, Event1());
+   bus.publish(&entity, Event1());
+   BOOST_CHECK( calls == 1 );
+
+   auto sub2 = bus.subscribe<Event1>(&entity, [&](void*, Event1 const &) { ++calls; });
+   bus.publish(&entity, Event1());
+   BOOST_CHECK( calls == 2 );
+}
+
+BOOST_AUTO_TEST_CASE( cancelSenderSubscriptionDuringDispatch )
+{
+   struct Event1 { };
+
+   MessageBus bus;
+   int entities[100];
+
+   int calls = 0;
+   auto sub = bus.subscribe<Event1>([&](void*, Event1 const &)
+   {
+      // each add is cancelled before it is applied, leaving nothing for its sender
+      for (auto & entity : entities)
+      {
+         auto cancelled = bus.subscribe<Event1>(&entity, [&](void*, Event1 const &) { ++calls; });
+      }
+   });
+
+   bus.publish(nullptr, Event1());
+   sub.reset();
+   for (auto & entity : entities) bus.publish(&entity, Event1());
+   BOOST_CHECK( calls == 0 );
+
+   auto sub2 = bus.subscribe<Event1>(&entities[0], [&](void*, Event1 const &) { ++calls; });
+   bus.publish(&entities[0], Event1());
+   BOOST_CHECK( calls == 1 );
+}
+
+BOOST_AUTO_TEST_CASE( subscriberThrowsDuringDispatch )
+{
+   struct Event1 { };
+
+   MessageBus bus;
+
+   int calls = 0;
+   Subscription added;
+   auto sub = bus.subscribe<Event1>([&](void*, Event1 const &)
+   {
+      if (!added.active()) added = bus.subscribe<Event1>([&](void*, Event1 const &) { ++calls; });
+      throw std::runtime_error("oops");
+   });
+
+   BOOST_CHECK_THROW( bus.publish(nullptr, Event1()), std::runtime_error );
+
+   // pending changes are still applied
+   sub.reset();
+   bus.publish(nullptr, Event1());
+   BOOST_CHECK( calls == 1 );
+}
+
+BOOST_AUTO_TEST_CASE( batchPublish )
+{
+   struct Contact { int a, b; };
+
+   MessageBus bus;
+   int world, other;
+
+   std::vector<int> single;
+   std::vector<std::size_t> batchSizes;
+   std::size_t singleCountAtBatch = 0;
+   int contactTotal = 0;
+   auto batchSub = bus.subscribeBatch<Contact>([&](void* sender, Span<Contact const> contacts)
+   {
+      BOOST_CHECK( sender == &world || sender == &other );
+      batchSizes.push_back(contacts.size());
+      singleCountAtBatch = single.size();
+      for (auto & c : contacts) contactTotal += c.a + c.b;
+   });
+
+   auto singleSub = bus.subscribe<Contact>([&](void*, Contact const & c) { single.push_back(c.a); });
+
+   std::vector<Contact> contacts;
+   for (int i = 0; i < 100; ++i) contacts.push_back(Contact{ i, 1 });
+
+   bus.publishBatch<Contact>(&world, contacts);
+   BOOST_CHECK( batchSizes == std::vector<std::size_t>({ 100 }) );
+   BOOST_CHECK( contactTotal == 4950 + 100 );
+   BOOST_CHECK( single.size() == 100 );
+   // per message subscribers see every message before the batch subscribers
+   BOOST_CHECK( singleCountAtBatch == 100 );
+   BOOST_CHECK( single.back() == 99 );
+
+   // single messages arrive as a batch of one
+   bus.publish(&world, Contact{ 1, 2 });
+   BOOST_CHECK( batchSizes.back() == 1 );
+
+   // queued messages are batched by runs of the same sender
+   batchSizes.clear();
+   single.clear();
+   auto channel = bus.channel<Contact>();
+   channel.enqueue(&world, Contact{ 0, 0 });
+   channel.enqueue(&world, Contact{ 0, 0 });
+   channel.enqueue(&other, Contact{ 0, 0 });
+   channel.enqueue(&world, Contact{ 0, 0 });
+   BOOST_CHECK( bus.dispatchPending() == 4 );
+   BOOST_CHECK( batchSizes == std::vector<std::size_t>({ 2, 1, 1 }) );
+   BOOST_CHECK( single.size() == 4 );
+
+   // unsubscribing from a batch subscriber during its own batch
+   batchSizes.clear();
+   Contact pair[2] = { { 1, 1 }, { 2, 2 } };
+   auto selfRemoving = bus.subscribeBatch<Contact>([&](void*, Span<Contact const>) { batchSub.reset(); });
+   channel.publishBatch(&world, pair);
+   channel.publishBatch(&world, pair);
+   BOOST_CHECK( batchSizes == std::vector<std::size_t>({ 2 }) );
+}
+
+BOOST_AUTO_TEST_CASE( scheduledPublish )
+{
+   struct Ping { int num; };
+   using std::chrono::milliseconds;
+
+   MessageBus bus;
+   int world;
+
+   std::vector<int> received;
+   auto sub = bus.subscribe<Ping>([&](void* sender, Ping const & ping)
+   {
+      BOOST_CHECK( sender == &world );
+      received.push_back(ping.num);
+   });
+
+   bus.publishAfter(milliseconds(500), &world, Ping{ 1 });
+   auto cancelled = bus.publishAfter(milliseconds(200), &world, Ping{ 2 });
+   auto repeating = bus.publishEvery(milliseconds(100), &world, Ping{ 3 });
+   BOOST_CHECK( bus.cancelTimer(cancelled) );
+   BOOST_CHECK( !bus.cancelTimer(cancelled) );
+
+   // a frame at a time, in seconds as Module::update sees it
+   for (int frame = 0; frame < 30; ++frame) bus.advanceTimersSeconds(1.0 / 60);
+   BOOST_CHECK( received == std::vector<int>({ 3, 3, 3, 3 }) );
+
+   BOOST_CHECK( bus.advanceTimers(milliseconds(100)) == 2 );
+   std::sort(received.begin(), received.end());
+   BOOST_CHECK( received == std::vector<int>({ 1, 3, 3, 3, 3, 3 }) );
+
+   BOOST_CHECK( bus.cancelTimer(repeating) );
+   BOOST_CHECK( bus.advanceTimers(milliseconds(1000)) == 0 );
+   BOOST_CHECK( received.size() == 6 );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,131 @@
+
+#include <boost/test/unit_test.hpp>
+using namespace boost::unit_test;
+
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/filesystem.hpp>
+#include <pcx/MessageRecorder.h>
+
+using namespace pcx;
+
+namespace
+{
+   struct Moved { int id; float x, y; };
+   struct Spawned { int id; };
+   struct Named { std::string name; };
+
+   struct TempFile
+   {
+      TempFile() : path((boost::filesystem::temp_directory_path() / boost::filesystem::unique_path("pcx-%%%%-%%%%.log")).string()) { }
+      ~TempFile() { boost::system::error_code ec; boost::filesystem::remove(path, ec); }
+      std::string path;
+   };
+}
+
+BOOST_AUTO_TEST_SUITE( MessageRecorderSuite )
+
+BOOST_AUTO_TEST_CASE( recordAndReplay )
+{
+   TempFile file;
+   int entities[2];
+
+   {
+      MessageBus bus;
+      MessageRecorder recorder(file.path);
+      recorder.record<Moved>(bus);
+      recorder.record<Spawned>(bus);
+      recorder.record<Named>(bus, [](Named const & msg, MessageRecorder::BufferT & out)
+      {
+         out.assign(msg.name.begin(), msg.name.end());
+      });
+
+      bus.publish(&entities[0], Spawned{ 1 });
+      // enough traffic to grow the mapping a few times
+      for (int i = 0; i < 50000; ++i) bus.publish(&entities[i % 2], Moved{ i, float(i), -float(i) });
+      bus.publish(&entities[1], Named{ "seven" });
+
+      BOOST_CHECK( recorder.recordCount() == 50002 );
+   }
+
+   MessageBus bus;
+   std::vector<Moved> moved;
+   int spawned = 0;
+   std::string name;
+   void* nameSender = nullptr;
+
+   auto sub1 = bus.subscribe<Moved>([&](void* sender, Moved const & msg)
+   {
+      BOOST_CHECK( sender == &entities[msg.id % 2] );
+      moved.push_back(msg);
+   });
+   auto sub2 = bus.subscribe<Spawned>([&](void*, Spawned const & msg) { spawned += msg.id; });
+   auto sub3 = bus.subscribe<Named>([&](void* sender, Named const & msg) { name = msg.name; nameSender = sender; });
+
+   MessageReplayer replayer(file.path);
+   replayer.add<Moved>();
+   replayer.add<Named>([](char const * data, std::size_t size) { return Named{ std::string(data, size) }; });
+
+   // Spawned wasn't registered with the replayer
+   BOOST_CHECK( replayer.replay(bus) == 50001 );
+   BOOST_CHECK( replayer.skippedCount() == 1 );
+   BOOST_CHECK( spawned == 0 );
+
+   BOOST_REQUIRE( moved.size() == 50000 );
+   for (int i = 0; i < 50000; ++i)
+   {
+      BOOST_CHECK( moved[i].id == i && moved[i].x == float(i) && moved[i].y == -float(i) );
+   }
+   BOOST_CHECK( name == "seven" );
+   BOOST_CHECK( nameSender == &entities[1] );
+}
+
+BOOST_AUTO_TEST_CASE( replayOriginalTime )
+{
+   TempFile file;
+
+   {
+      MessageBus bus;
+      MessageRecorder recorder(file.path);
+      recorder.record<Spawned>(bus);
+
+      bus.publish(nullptr, Spawned{ 1 });
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+      bus.publish(nullptr, Spawned{ 2 });
+      recorder.stop();
+
+      // no longer recording
+      bus.publish(nullptr, Spawned{ 3 });
+      BOOST_CHECK( recorder.recordCount() == 2 );
+   }
+
+   MessageBus bus;
+   std::vector<std::chrono::steady_clock::time_point> times;
+   auto sub = bus.subscribe<Spawned>([&](void*, Spawned const &) { times.push_back(std::chrono::steady_clock::now()); });
+
+   MessageReplayer replayer(file.path);
+   replayer.add<Spawned>();
+   auto start = std::chrono::steady_clock::now();
+   BOOST_CHECK( replayer.replay(bus, MessageReplayer::Pacing::OriginalTime) == 2 );
+
+   // each message is replayed no earlier than its offset from the start of the
+   // replay, however late the one before it was
+   BOOST_REQUIRE( times.size() == 2 );
+   BOOST_CHECK( times[1] - start >= std::chrono::milliseconds(20) );
+}
+
+BOOST_AUTO_TEST_CASE( notALog )
+{
+   TempFile file;
+   {
+      std::ofstream out(file.path);
+      out << "definitely not a message log";
+   }
+
+   BOOST_CHECK_THROW( MessageReplayer replayer(file.path), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,148 @@
+
+#include <boost/test/unit_test.hpp>
+using namespace boost::unit_test;
+
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <pcx/MessageBus.h>
+#include <pcx/Routine.h>
+
+using namespace pcx;
+
+namespace
+{
+   struct Opened { int id; };
+   struct Closed { std::string reason; };
+
+   Routine openThenClose(MessageBus & bus, void* door, std::vector<std::string> & log)
+   {
+      auto opened = co_await bus.next<Opened>(door);
+      log.push_back("opened " + std::to_string(opened.id));
+
+      auto closed = co_await bus.next<Closed>(door);
+      log.push_back("closed " + closed.reason);
+   }
+
+   Routine countOpens(MessageBus & bus, int & count, ResumeOn resumeOn)
+   {
+      for (;;)
+      {
+         co_await bus.next<Opened>(resumeOn);
+         ++count;
+      }
+   }
+
+   Routine failOnOpen(MessageBus & bus)
+   {
+      co_await bus.next<Opened>();
+      throw std::runtime_error("oops");
+   }
+}
+
+BOOST_AUTO_TEST_SUITE( RoutineSuite )
+
+BOOST_AUTO_TEST_CASE( awaitMessageSequence )
+{
+   MessageBus bus;
+   int doors[2];
+   std::vector<std::string> log;
+
+   auto routine = openThenClose(bus, &doors[0], log);
+   BOOST_CHECK( !routine.done() );
+
+   // out of order, and from the wrong sender
+   bus.publish(&doors[0], Closed{ "early" });
+   bus.publish(&doors[1], Opened{ 1 });
+   BOOST_CHECK( log.empty() );
+
+   bus.publish(&doors[0], Opened{ 2 });
+   BOOST_CHECK( log == std::vector<std::string>({ "opened 2" }) );
+
+   bus.enqueue(&doors[0], Closed{ "queued" });
+   BOOST_CHECK( log.size() == 1 );
+   bus.dispatchPending();
+   BOOST_CHECK( log == std::vector<std::string>({ "opened 2", "closed queued" }) );
+   BOOST_CHECK( routine.done() );
+   BOOST_CHECK( !routine.error() );
+}
+
+BOOST_AUTO_TEST_CASE( resumeOnPublish )
+{
+   MessageBus bus;
+   int count = 0;
+   int subscriberCount = 0;
+   auto sub = bus.subscribe<Opened>([&](void*, Opened const &)
+   {
+      // subscribers run before waiting coroutines
+      BOOST_CHECK( subscriberCount == count );
+      ++subscriberCount;
+   });
+
+   auto routine = countOpens(bus, count, ResumeOn::Publish);
+
+   // waiting again from inside the resumed coroutine doesn't see the same message
+   bus.publish(nullptr, Opened{ 1 });
+   BOOST_CHECK( count == 1 );
+   bus.publish(nullptr, Opened{ 2 });
+   BOOST_CHECK( count == 2 );
+   BOOST_CHECK( subscriberCount == 2 );
+}
+
+BOOST_AUTO_TEST_CASE( resumeOnDispatchPending )
+{
+   MessageBus bus;
+   int count = 0;
+   auto routine = countOpens(bus, count, ResumeOn::DispatchPending);
+
+   bus.publish(nullptr, Opened{ 1 });
+   bus.publish(nullptr, Opened{ 2 });
+   BOOST_CHECK( count == 0 );
+
+   // only the first message was waited for
+   bus.dispatchPending();
+   BOOST_CHECK( count == 1 );
+   bus.dispatchPending();
+   BOOST_CHECK( count == 1 );
+
+   bus.publish(nullptr, Opened{ 3 });
+   bus.dispatchPending();
+   BOOST_CHECK( count == 2 );
+}
+
+BOOST_AUTO_TEST_CASE( destroyWaitingRoutine )
+{
+   MessageBus bus;
+   int count1 = 0, count2 = 0, count3 = 0;
+
+   auto routine1 = countOpens(bus, count1, ResumeOn::Publish);
+   auto routine2 = countOpens(bus, count2, ResumeOn::Publish);
+   auto routine3 = countOpens(bus, count3, ResumeOn::DispatchPending);
+
+   routine2.reset();
+   bus.publish(nullptr, Opened{ 1 });
+   BOOST_CHECK( count1 == 1 );
+   BOOST_CHECK( count2 == 0 );
+
+   // cancelled while waiting to be resumed
+   routine3.reset();
+   bus.dispatchPending();
+   BOOST_CHECK( count3 == 0 );
+
+   routine1 = Routine();
+   bus.publish(nullptr, Opened{ 2 });
+   BOOST_CHECK( count1 == 1 );
+}
+
+BOOST_AUTO_TEST_CASE( routineException )
+{
+   MessageBus bus;
+
+   auto routine = failOnOpen(bus);
+
+   bus.publish(nullptr, Opened{ 1 });
+   BOOST_CHECK( routine.done() );
+   BOOST_CHECK_THROW( std::rethrow_exception(routine.error()), std::runtime_error );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,9 +2,14 @@
 #include <boost/test/unit_test.hpp>
 using namespace boost::unit_test;
 
+#include <atomic>
+#include <random>
 #include <set>
+#include <stdexcept>
+#include <vector>
 #include <pcx/IndexPool.h>
 #include <pcx/ServiceRegistry.h>
+#include <pcx/WorkerPool.h>
 
 using namespace pcx;
 
@@ -87,6 +92,407 @@ BOOST_AUTO_TEST_CASE( reallocation )
    }
 }
 
+BOOST_AUTO_TEST_CASE( freeUntilEmpty )
+{
+   auto list = IndexPool(10);
+
+   // frees the only live index, then the tail of the free list twice in a row
+   list.Free(list.Allocate());
+   for (int i = 0; i < 10; i++)
+   {
+      list.Allocate();
+   }
+   for (long i = 0; i < 10; i++)
+   {
+      list.Free(i);
+   }
+   BOOST_CHECK(0 == list.Size());
+
+   int visited = 0;
+   list.ForEach([&](long) { ++visited; });
+   BOOST_CHECK(0 == visited);
+
+   std::set<long> reallocIndexes;
+   for (int i = 0; i < 10; i++)
+   {
+      reallocIndexes.insert(list.Allocate());
+   }
+   BOOST_CHECK(10 == reallocIndexes.size());
+}
+
+BOOST_AUTO_TEST_CASE( growablePool )
+{
+   auto list = IndexPool(10, 16);
+   BOOST_CHECK(16 == list.Reserved());
+   BOOST_CHECK(16 == list.ChunkSize());
+   BOOST_CHECK_THROW(IndexPool(10, 12), std::runtime_error);
+
+   // parallel data grows with the pool without moving
+   ChunkedArray<long> data(list.ChunkSize());
+   data.Resize(list.Reserved());
+   long * first = nullptr;
+
+   std::set<long> indexes;
+   for (int i = 0; i < 100; i++)
+   {
+      auto idx = list.Allocate();
+      BOOST_CHECK(indexes.insert(idx).second);
+
+      data.Resize(list.Reserved());
+      data[idx] = idx;
+      if (nullptr == first) first = &data[idx];
+   }
+   BOOST_CHECK(112 == list.Reserved());
+   BOOST_CHECK(112 == data.Size());
+   BOOST_CHECK(first == &data[*indexes.begin()]);
+   BOOST_CHECK(0 == *first);
+
+   long visited = 0;
+   list.ForEach([&](long idx) { BOOST_CHECK(data[idx] == idx); ++visited; });
+   BOOST_CHECK(100 == visited);
+}
+
+BOOST_AUTO_TEST_CASE( shrinkPool )
+{
+   auto list = IndexPool(0, 8);
+
+   for (int i = 0; i < 40; i++)
+   {
+      list.Allocate();
+   }
+   BOOST_CHECK(40 == list.Reserved());
+
+   // the last chunk is still in use
+   list.Free(10);
+   list.Free(36);
+   BOOST_CHECK(40 == list.Shrink());
+
+   for (long i = 16; i < 40; i++)
+   {
+      if (i != 20 && i != 36) list.Free(i);
+   }
+   BOOST_CHECK(24 == list.Shrink());
+   list.Free(20);
+   BOOST_CHECK(16 == list.Shrink());
+
+   // only indices that survived the shrink are handed out, and then the pool grows again
+   std::set<long> reallocIndexes;
+   for (int i = 0; i < 8; i++)
+   {
+      reallocIndexes.insert(list.Allocate());
+   }
+   BOOST_CHECK(*reallocIndexes.begin() == 10);
+   BOOST_CHECK(*reallocIndexes.rbegin() == 22);
+   BOOST_CHECK(24 == list.Reserved());
+   BOOST_CHECK(23 == list.Size());
+
+   // a fixed pool never shrinks
+   auto fixed = IndexPool(10);
+   BOOST_CHECK(10 == fixed.Shrink());
+}
+
+BOOST_AUTO_TEST_CASE( ascendingForEach )
+{
+   auto list = IndexPool(300, 32);
+   std::set<long> live;
+   std::mt19937 random(11);
+
+   for (int i = 0; i < 20000; ++i)
+   {
+      if (live.empty() || random() % 3)
+      {
+         BOOST_REQUIRE(live.insert(list.Allocate()).second);
+      }
+      else
+      {
+         auto it = live.begin();
+         std::advance(it, random() % live.size());
+         list.Free(*it);
+         live.erase(it);
+      }
+      if (live.size() > 1000) { list.Free(*live.begin()); live.erase(live.begin()); }
+   }
+
+   // every live index, in strictly ascending order
+   std::vector<long> visited;
+   list.ForEach([&](long idx) { visited.push_back(idx); });
+   BOOST_CHECK(std::vector<long>(live.begin(), live.end()) == visited);
+
+   for (long idx = 0; idx < list.Reserved(); ++idx) BOOST_CHECK(list.IsAllocated(idx) == (live.count(idx) == 1));
+   BOOST_CHECK(!list.IsAllocated(-1));
+   BOOST_CHECK(!list.IsAllocated(list.Reserved()));
+}
+
+BOOST_AUTO_TEST_CASE( lowestFreePolicy )
+{
+   auto list = IndexPool(100, AllocationPolicy::LowestFree);
+   BOOST_CHECK(AllocationPolicy::LowestFree == list.Policy());
+   for (long i = 0; i < 100; ++i) BOOST_CHECK(i == list.Allocate());
+   BOOST_CHECK_THROW(list.Allocate(), std::runtime_error);
+
+   list.Free(80);
+   list.Free(5);
+   list.Free(37);
+   BOOST_CHECK(5 == list.Allocate());
+   BOOST_CHECK(37 == list.Allocate());
+   BOOST_CHECK(80 == list.Allocate());
+
+   // large enough for several levels of free bitmap, growing and shrinking
+   auto grown = IndexPool(0, 1 << 16, AllocationPolicy::LowestFree);
+   std::set<long> live, free;
+   std::mt19937 random(13);
+   for (long i = 0; i < 300000; ++i) live.insert(grown.Allocate());
+   BOOST_CHECK(299999 == *live.rbegin());
+
+   for (int i = 0; i < 20000; ++i)
+   {
+      if (random() % 2)
+      {
+         auto it = live.lower_bound(static_cast<long>(random() % 300000));
+         if (it == live.end()) continue;
+         grown.Free(*it);
+         free.insert(*it);
+         live.erase(it);
+      }
+      else if (!free.empty())
+      {
+         BOOST_REQUIRE(*free.begin() == grown.Allocate());
+         live.insert(*free.begin());
+         free.erase(free.begin());
+      }
+   }
+
+   while (*live.rbegin() >= 1 << 16) { grown.Free(*live.rbegin()); live.erase(*live.rbegin()); }
+   BOOST_CHECK(1 << 16 == grown.Shrink());
+   free.erase(free.lower_bound(1 << 16), free.end());
+
+   while (!free.empty())
+   {
+      BOOST_REQUIRE(*free.begin() == grown.Allocate());
+      free.erase(free.begin());
+   }
+   BOOST_CHECK(1 << 16 == grown.Allocate());
+}
+
+BOOST_AUTO_TEST_CASE( batchAllocateAndFree )
+{
+   auto list = IndexPool(10);
+   list.Allocate();
+
+   std::vector<long> batch(6);
+   list.Allocate(4, batch);
+   BOOST_CHECK(5 == list.Size());
+   BOOST_CHECK(std::vector<long>({ 1, 2, 3, 4, 0, 0 }) == batch);
+
+   // the batch follows the earlier index in allocation order
+   std::vector<long> order;
+   for (auto idx = list.First(); -1 != idx; idx = list.Next(idx)) order.push_back(idx);
+   BOOST_CHECK(std::vector<long>({ 0, 1, 2, 3, 4 }) == order);
+
+   // failures leave the pool as it was
+   BOOST_CHECK_THROW(list.Allocate(6, batch), std::runtime_error);
+   BOOST_CHECK_THROW(list.Allocate(7, batch), std::runtime_error);
+   BOOST_CHECK(5 == list.Size());
+
+   std::vector<long> duplicate = { 1, 3, 1 };
+   std::vector<long> unallocated = { 2, 9 };
+   std::vector<long> outOfRange = { 2, 10 };
+   BOOST_CHECK_THROW(list.Free(duplicate), std::runtime_error);
+   BOOST_CHECK_THROW(list.Free(unallocated), std::runtime_error);
+   BOOST_CHECK_THROW(list.Free(outOfRange), std::runtime_error);
+   BOOST_CHECK_THROW(list.Free(-1L), std::runtime_error);
+   BOOST_CHECK_THROW(list.Free(10L), std::runtime_error);
+   BOOST_CHECK(5 == list.Size());
+
+   std::vector<long> visited;
+   list.ForEach([&](long idx) { visited.push_back(idx); });
+   BOOST_CHECK(std::vector<long>({ 0, 1, 2, 3, 4 }) == visited);
+
+   std::vector<long> some = { 3, 0, 2 };
+   list.Free(some);
+   BOOST_CHECK(2 == list.Size());
+   order.clear();
+   for (auto idx = list.First(); -1 != idx; idx = list.Next(idx)) order.push_back(idx);
+   BOOST_CHECK(std::vector<long>({ 1, 4 }) == order);
+
+   // freed indices are reused in the order they were freed
+   batch.assign(8, -1);
+   list.Allocate(8, batch);
+   BOOST_CHECK(std::vector<long>({ 5, 6, 7, 8, 9, 3, 0, 2 }) == batch);
+   BOOST_CHECK(10 == list.Size());
+   BOOST_CHECK_THROW(list.Allocate(), std::runtime_error);
+
+   list.Free(batch);
+   list.Allocate(0, batch);
+   BOOST_CHECK(2 == list.Size());
+
+   // growable pools add every chunk needed up front
+   auto grown = IndexPool(0, 8);
+   batch.assign(20, -1);
+   grown.Allocate(20, batch);
+   BOOST_CHECK(24 == grown.Reserved());
+   for (long i = 0; i < 20; ++i) BOOST_CHECK(i == batch[i]);
+
+   auto lowest = IndexPool(0, 8, AllocationPolicy::LowestFree);
+   lowest.Allocate(20, batch);
+   std::vector<long> odd = { 1, 7, 13 };
+   lowest.Free(odd);
+   lowest.Allocate(5, batch);
+   BOOST_CHECK(std::vector<long>({ 1, 7, 13, 20, 21 }) == std::vector<long>(batch.begin(), batch.begin() + 5));
+   BOOST_CHECK(22 == lowest.Size());
+}
+
+BOOST_AUTO_TEST_CASE( parallelForEach )
+{
+   const long size = 100000;
+   auto list = IndexPool(size);
+   std::mt19937 random(17);
+   for (long i = 0; i < size; ++i) list.Allocate();
+   for (long i = 0; i < size; ++i) if (random() % 3) list.Free(i);
+
+   std::vector<std::atomic<int>> visits(size);
+   for (auto & visit : visits) visit = 0;
+
+   WorkerPool workers(4);
+   list.ParallelForEach(workers, [&](long idx) { ++visits[idx]; }, 1000);
+   for (long idx = 0; idx < size; ++idx) BOOST_REQUIRE(visits[idx] == (list.IsAllocated(idx) ? 1 : 0));
+
+   // collect the ranges, in order
+   typedef std::vector<std::vector<long>> Ranges;
+   auto ranges = list.ParallelReduce(workers, Ranges(), [](Ranges & acc, long idx)
+   {
+      if (acc.empty()) acc.push_back(std::vector<long>());
+      acc.back().push_back(idx);
+   }, [](Ranges all, Ranges range)
+   {
+      all.insert(all.end(), range.begin(), range.end());
+      return all;
+   }, 1000);
+
+   std::vector<long> all, serial;
+   list.ForEach([&](long idx) { serial.push_back(idx); });
+   for (std::size_t i = 0; i < ranges.size(); ++i)
+   {
+      all.insert(all.end(), ranges[i].begin(), ranges[i].end());
+
+      // every range but the last holds at least grain indices, and none share a block of 64
+      if (i + 1 < ranges.size())
+      {
+         BOOST_CHECK(ranges[i].size() >= 1000);
+         BOOST_CHECK(ranges[i].back() / 64 < ranges[i + 1].front() / 64);
+      }
+   }
+   BOOST_CHECK(serial == all);
+   BOOST_CHECK(ranges.size() > 4);
+
+   // the same sum, to the bit, however many threads add it up
+   auto sum = [&](WorkerPool & pool)
+   {
+      return list.ParallelReduce(pool, 0.0, [](double & acc, long idx) { acc += 1.0 / (idx + 1); },
+         [](double a, double b) { return a + b; }, 500);
+   };
+   WorkerPool single(1);
+   auto expected = sum(single);
+   for (int i = 0; i < 10; ++i) BOOST_CHECK(expected == sum(workers));
+
+   BOOST_CHECK_THROW(list.ParallelForEach(workers, [&](long idx)
+   {
+      if (idx == serial[serial.size() / 2]) throw std::runtime_error("test");
+   }, 1000), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE( compactPool )
+{
+   for (auto policy : { AllocationPolicy::Fifo, AllocationPolicy::LowestFree })
+   {
+      auto list = IndexPool(0, 64, policy);
+      ChunkedArray<long> data(64);
+      std::mt19937 random(19);
+
+      for (long i = 0; i < 300; ++i)
+      {
+         auto idx = list.Allocate();
+         data.Resize(list.Reserved());
+         data[idx] = idx * 10;
+      }
+      for (long i = 0; i < 300; ++i) if (random() % 3) list.Free(i);
+
+      std::vector<long> before, order;
+      list.ForEach([&](long idx) { before.push_back(idx); });
+      for (auto idx = list.First(); -1 != idx; idx = list.Next(idx)) order.push_back(idx);
+
+      auto remap = list.Compact();
+      ApplyRemap(remap, data);
+      BOOST_CHECK(320 == static_cast<long>(remap.size()));
+
+      // packed, in the same order, with the data following
+      std::vector<long> after;
+      list.ForEach([&](long idx) { after.push_back(idx); });
+      BOOST_REQUIRE(before.size() == after.size());
+      for (std::size_t i = 0; i < after.size(); ++i)
+      {
+         BOOST_CHECK(static_cast<long>(i) == after[i]);
+         BOOST_CHECK(static_cast<long>(i) == remap[before[i]]);
+         BOOST_CHECK(before[i] * 10 == data[after[i]]);
+      }
+
+      std::vector<long> reordered;
+      for (auto idx = list.First(); -1 != idx; idx = list.Next(idx)) reordered.push_back(idx);
+      for (auto & idx : order) idx = remap[idx];
+      BOOST_CHECK(order == reordered);
+
+      // the freed chunks can be released, and allocation carries on above the packed indices
+      auto size = list.Size();
+      BOOST_CHECK((size + 63) / 64 * 64 == list.Shrink());
+      BOOST_CHECK(size == list.Allocate());
+      list.Free(0);
+      BOOST_CHECK(size == list.Size());
+   }
+}
+
+BOOST_AUTO_TEST_CASE( indexWidths )
+{
+   // the widest pool behaves just like the default one
+   IndexPool narrow(0, 16);
+   IndexPool64 wide(0, 16);
+   std::mt19937 random(23);
+   for (long i = 0; i < 2000; ++i)
+   {
+      if (0 != narrow.Size() && 0 == random() % 3)
+      {
+         auto idx = narrow.First();
+         narrow.Free(idx);
+         wide.Free(idx);
+      }
+      else
+      {
+         BOOST_CHECK(narrow.Allocate() == wide.Allocate());
+      }
+   }
+   BOOST_CHECK(narrow.Size() == wide.Size());
+   BOOST_CHECK(narrow.Reserved() == wide.Reserved());
+   for (auto n = narrow.First(), w = wide.First(); -1 != n || -1 != w; n = narrow.Next(n), w = wide.Next(w))
+   {
+      BOOST_REQUIRE(n == w);
+   }
+   BOOST_CHECK(narrow.Compact() == wide.Compact());
+
+   // the largest value of a narrow index type marks the end of a list, so it is never handed out
+   IndexPool16 small(65535);
+   std::vector<long> all(65535);
+   small.Allocate(65535, all);
+   BOOST_CHECK(65534 == all.back());
+   BOOST_CHECK(-1 == small.Next(65534));
+   small.Free(all);
+   BOOST_CHECK(0 == small.Size());
+
+   BOOST_CHECK_THROW(IndexPool16(65536), std::runtime_error);
+   // a growable pool stops at its last whole chunk that fits
+   IndexPool16 growable(0, 1 << 14);
+   growable.Allocate(3 << 14, all);
+   BOOST_CHECK_THROW(growable.Allocate(), std::runtime_error);
+   BOOST_CHECK(3 << 14 == growable.Size());
+}
 
 BOOST_AUTO_TEST_CASE( ServiceRegistry_different_registration_types )
 {
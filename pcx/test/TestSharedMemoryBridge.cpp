@@ -0,0 +1,190 @@
+
+#include <boost/test/unit_test.hpp>
+using namespace boost::unit_test;
+
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <pcx/SharedMemoryBridge.h>
+
+#if defined(__unix__)
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using namespace pcx;
+
+namespace
+{
+   struct Tick { std::uint32_t producer; std::uint32_t count; };
+   struct Moved { int id; float x, y; };
+   struct Unknown { char bytes[12]; };
+
+   std::string ringName(char const * test)
+   {
+#if defined(__unix__)
+      return std::string("pcx-test-") + test + "-" + std::to_string(getpid());
+#else
+      return std::string("pcx-test-") + test;
+#endif
+   }
+
+#if defined(__unix__)
+   /// Runs f in a child process, which exits with f's result
+   template <typename F>
+   pid_t spawn(F f)
+   {
+      auto pid = fork();
+      if (0 == pid)
+      {
+         int status = 1;
+         try { status = f(); } catch (...) { }
+         _exit(status);
+      }
+      return pid;
+   }
+
+   /// @return whether the child process exited cleanly
+   bool joined(pid_t pid)
+   {
+      int status = 0;
+      return pid == waitpid(pid, &status, 0) && WIFEXITED(status) && 0 == WEXITSTATUS(status);
+   }
+#endif
+}
+
+BOOST_AUTO_TEST_SUITE( SharedMemoryBridgeSuite )
+
+BOOST_AUTO_TEST_CASE( sameProcess )
+{
+   int entity;
+   MessageBus source;
+   MessageBus target;
+
+   MessageBusImporter importer(ringName("same"));
+   importer.add<Moved>();
+   MessageBusExporter exporter(ringName("same"));
+   exporter.forward<Moved>(source);
+
+   std::vector<Moved> received;
+   void* receivedSender = nullptr;
+   auto sub = target.subscribe<Moved>([&](void* sender, Moved const & m) { receivedSender = sender; received.push_back(m); });
+
+   BOOST_CHECK(!importer.wait(std::chrono::milliseconds(1)));
+   BOOST_CHECK_EQUAL(0, importer.poll(target));
+
+   source.publish(&entity, Moved{ 7, 1.5f, -2.f });
+   BOOST_CHECK(importer.wait(std::chrono::milliseconds(0)));
+   BOOST_CHECK_EQUAL(1, importer.poll(target));
+   BOOST_REQUIRE_EQUAL(1, received.size());
+   BOOST_CHECK_EQUAL(7, received[0].id);
+   BOOST_CHECK_EQUAL(1.5f, received[0].x);
+   BOOST_CHECK_EQUAL(-2.f, received[0].y);
+   BOOST_CHECK_EQUAL(&entity, receivedSender);
+
+   // types the importer doesn't know are skipped
+   BOOST_CHECK(exporter.send(nullptr, Unknown()));
+   BOOST_CHECK_EQUAL(0, importer.poll(target));
+   BOOST_CHECK_EQUAL(1, importer.skippedCount());
+}
+
+BOOST_AUTO_TEST_CASE( fullRingDrops )
+{
+   MessageBus target;
+   MessageBusImporter importer(ringName("full"), 4);
+   importer.add<Tick>();
+   MessageBusExporter exporter(ringName("full"));
+
+   for (std::uint32_t i = 0; i < 4; ++i) BOOST_CHECK(exporter.send(nullptr, Tick{ 0, i }));
+   BOOST_CHECK(!exporter.send(nullptr, Tick{ 0, 4 }));
+   BOOST_CHECK_EQUAL(1, exporter.droppedCount());
+
+   std::vector<std::uint32_t> counts;
+   auto sub = target.subscribe<Tick>([&](void*, Tick const & t) { counts.push_back(t.count); });
+   BOOST_CHECK_EQUAL(4, importer.poll(target));
+   BOOST_CHECK((std::vector<std::uint32_t>{ 0, 1, 2, 3 }) == counts);
+
+   // slots are reused once read
+   BOOST_CHECK(exporter.send(nullptr, Tick{ 0, 5 }));
+   BOOST_CHECK_EQUAL(1, importer.poll(target));
+   BOOST_CHECK_EQUAL(5, counts.back());
+}
+
+BOOST_AUTO_TEST_CASE( badRings )
+{
+   BOOST_CHECK_THROW(MessageBusExporter(ringName("missing")), std::runtime_error);
+   BOOST_CHECK_THROW(MessageBusImporter(ringName("odd"), 1000), std::runtime_error);
+
+   struct Big { char bytes[1024]; };
+   MessageBusImporter importer(ringName("small"), 16, 64);
+   MessageBusExporter exporter(ringName("small"));
+   BOOST_CHECK_THROW(exporter.send(nullptr, Big()), std::runtime_error);
+}
+
+#if defined(__unix__)
+BOOST_AUTO_TEST_CASE( twoProcesses )
+{
+   static const std::uint32_t producers = 3;
+   static const std::uint32_t perProducer = 20000;    // many times the ring size
+
+   // the children have pids of their own
+   auto name = ringName("procs");
+
+   MessageBus bus;
+   MessageBusImporter importer(name, 256);
+   importer.add<Tick>();
+
+   std::vector<std::uint32_t> next(producers, 0);
+   std::uint32_t received = 0;
+   bool ordered = true;
+   auto sub = bus.subscribe<Tick>([&](void* sender, Tick const & t)
+   {
+      ordered = ordered && reinterpret_cast<std::uintptr_t>(sender) == t.producer + 1 && next[t.producer] == t.count;
+      next[t.producer] = t.count + 1;
+      ++received;
+   });
+
+   std::vector<pid_t> children;
+   for (std::uint32_t p = 0; p < producers; ++p)
+   {
+      children.push_back(spawn([p, &name]
+      {
+         // the child gets its own bus, forwarding into the parent's ring
+         MessageBus local;
+         MessageBusExporter exporter(name);
+         exporter.forward<Tick>(local);
+
+         auto sender = reinterpret_cast<void*>(static_cast<std::uintptr_t>(p + 1));
+         for (std::uint32_t i = 0; i < perProducer; ++i)
+         {
+            // back off while the consumer catches up, nothing may be lost
+            auto dropped = exporter.droppedCount();
+            local.publish(sender, Tick{ p, i });
+            while (exporter.droppedCount() != dropped)
+            {
+               dropped = exporter.droppedCount();
+               usleep(50);
+               exporter.send(sender, Tick{ p, i });
+            }
+         }
+         return 0;
+      }));
+      BOOST_REQUIRE(children.back() > 0);
+   }
+
+   auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(30);
+   while (received < producers * perProducer && std::chrono::steady_clock::now() < deadline)
+   {
+      importer.wait(std::chrono::milliseconds(100));
+      importer.poll(bus);
+   }
+
+   for (auto child : children) BOOST_CHECK(joined(child));
+   BOOST_CHECK_EQUAL(producers * perProducer, received);
+   BOOST_CHECK(ordered);
+   BOOST_CHECK_EQUAL(0, importer.skippedCount());
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
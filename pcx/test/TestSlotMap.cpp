@@ -0,0 +1,108 @@
+
+#include <boost/test/unit_test.hpp>
+using namespace boost::unit_test;
+
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <pcx/SlotMap.h>
+
+using namespace pcx;
+
+BOOST_AUTO_TEST_SUITE( SlotMapSuite )
+
+BOOST_AUTO_TEST_CASE( insertAndErase )
+{
+   SlotMap<std::string> map(4);
+
+   auto a = map.Insert("a");
+   auto b = map.Emplace(3, 'b');
+   BOOST_CHECK_EQUAL(2, map.Size());
+   BOOST_CHECK_EQUAL("a", map.Get(a));
+   BOOST_CHECK_EQUAL("bbb", *map.Find(b));
+
+   BOOST_CHECK(map.Erase(a));
+   BOOST_CHECK(!map.Contains(a));
+   BOOST_CHECK(nullptr == map.Find(a));
+   BOOST_CHECK_THROW(map.Get(a), std::runtime_error);
+   BOOST_CHECK(!map.Erase(a));
+
+   // the values stay packed
+   BOOST_CHECK_EQUAL(1, map.Size());
+   BOOST_CHECK_EQUAL("bbb", map.Data()[0]);
+   BOOST_CHECK(b == map.HandleAt(0));
+}
+
+BOOST_AUTO_TEST_CASE( staleHandlesDontAlias )
+{
+   SlotMap<int> map(1);
+
+   auto first = map.Insert(1);
+   map.Erase(first);
+
+   // the only index is reused, with a new generation
+   auto second = map.Insert(2);
+   BOOST_CHECK_EQUAL(first.index, second.index);
+   BOOST_CHECK(first != second);
+   BOOST_CHECK(nullptr == map.Find(first));
+   BOOST_CHECK(!map.Erase(first));
+   BOOST_CHECK_EQUAL(2, map.Get(second));
+
+   BOOST_CHECK(!map.Contains(SlotMap<int>::Handle()));
+   BOOST_CHECK_THROW(map.Insert(3), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_CASE( throwingInsert )
+{
+   struct Throws
+   {
+      Throws(bool fail) { if (fail) throw std::runtime_error("test"); }
+   };
+
+   SlotMap<Throws> map(1);
+   BOOST_CHECK_THROW(map.Emplace(true), std::runtime_error);
+   BOOST_CHECK_EQUAL(0, map.Size());
+
+   // the index taken for the failed insert was given back
+   map.Emplace(false);
+   BOOST_CHECK_EQUAL(1, map.Size());
+}
+
+BOOST_AUTO_TEST_CASE( churn )
+{
+   SlotMap<std::unique_ptr<int>> map(100);
+   std::vector<std::pair<SlotMap<std::unique_ptr<int>>::Handle, int>> live;
+   std::vector<SlotMap<std::unique_ptr<int>>::Handle> dead;
+   std::mt19937 random(7);
+
+   for (int i = 0; i < 10000; ++i)
+   {
+      if (live.size() < 100 && (live.empty() || random() % 2))
+      {
+         live.push_back(std::make_pair(map.Insert(std::unique_ptr<int>(new int(i))), i));
+      }
+      else
+      {
+         auto it = live.begin() + random() % live.size();
+         BOOST_REQUIRE(map.Erase(it->first));
+         dead.push_back(it->first);
+         live.erase(it);
+      }
+   }
+
+   BOOST_CHECK_EQUAL(live.size(), map.Size());
+   for (auto & entry : live) BOOST_CHECK_EQUAL(entry.second, *map.Get(entry.first));
+   for (auto & handle : dead) BOOST_CHECK(!map.Contains(handle));
+
+   long visited = 0;
+   map.ForEach([&](SlotMap<std::unique_ptr<int>>::Handle handle, std::unique_ptr<int> & value)
+   {
+      BOOST_CHECK(map.Find(handle) == &value);
+      ++visited;
+   });
+   BOOST_CHECK_EQUAL(map.Size(), visited);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,153 @@
+
+#include <boost/test/unit_test.hpp>
+using namespace boost::unit_test;
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <vector>
+#include <pcx/TimerWheel.h>
+
+using namespace pcx;
+using std::chrono::milliseconds;
+
+BOOST_AUTO_TEST_SUITE( TimerWheelSuite )
+
+BOOST_AUTO_TEST_CASE( fireInOrder )
+{
+   TimerWheel wheel;
+   std::vector<int> fired;
+
+   wheel.schedule(milliseconds(30), [&]() { fired.push_back(3); });
+   wheel.schedule(milliseconds(10), [&]() { fired.push_back(1); });
+   wheel.schedule(milliseconds(10), [&]() { fired.push_back(2); });
+   BOOST_CHECK_EQUAL(3, wheel.size());
+
+   BOOST_CHECK_EQUAL(0, wheel.advance(milliseconds(9)));
+   BOOST_CHECK_EQUAL(2, wheel.advance(milliseconds(1)));
+   BOOST_CHECK(fired == std::vector<int>({ 1, 2 }));
+
+   BOOST_CHECK_EQUAL(1, wheel.advance(milliseconds(100)));
+   BOOST_CHECK(fired == std::vector<int>({ 1, 2, 3 }));
+   BOOST_CHECK_EQUAL(0, wheel.size());
+}
+
+BOOST_AUTO_TEST_CASE( neverEarly )
+{
+   TimerWheel wheel;
+   bool fired = false;
+
+   // half way through a tick, so the timer is due half way through another
+   wheel.advance(std::chrono::microseconds(500));
+   wheel.schedule(milliseconds(1), [&]() { fired = true; });
+   wheel.advance(std::chrono::microseconds(999));
+   BOOST_CHECK(!fired);
+   wheel.advance(std::chrono::microseconds(1));
+   BOOST_CHECK(!fired);
+   wheel.advance(milliseconds(1));
+   BOOST_CHECK(fired);
+
+   // even a zero delay waits for the next tick
+   fired = false;
+   wheel.schedule(milliseconds(0), [&]() { fired = true; });
+   BOOST_CHECK(!fired);
+   wheel.advance(milliseconds(1));
+   BOOST_CHECK(fired);
+}
+
+BOOST_AUTO_TEST_CASE( repeatAndCancel )
+{
+   TimerWheel wheel;
+   int count = 0;
+
+   TimerId id = wheel.scheduleRepeating(milliseconds(5), milliseconds(10), [&]() { ++count; });
+   wheel.advance(milliseconds(5));
+   BOOST_CHECK_EQUAL(1, count);
+
+   // one long frame catches up on every interval
+   wheel.advance(milliseconds(100));
+   BOOST_CHECK_EQUAL(11, count);
+   BOOST_CHECK(wheel.scheduled(id));
+
+   BOOST_CHECK(wheel.cancel(id));
+   BOOST_CHECK(!wheel.scheduled(id));
+   BOOST_CHECK(!wheel.cancel(id));
+   wheel.advance(milliseconds(100));
+   BOOST_CHECK_EQUAL(11, count);
+
+   // the released node is reused without reviving the old id
+   auto other = wheel.schedule(milliseconds(1), [&]() { });
+   BOOST_CHECK_EQUAL(id.index, other.index);
+   BOOST_CHECK(!wheel.cancel(id));
+   BOOST_CHECK(wheel.scheduled(other));
+}
+
+BOOST_AUTO_TEST_CASE( callbacksChangeTimers )
+{
+   TimerWheel wheel;
+   int count = 0;
+   TimerId self;
+
+   // cancels itself on the third call, scheduling more timers along the way
+   self = wheel.scheduleRepeating(milliseconds(1), milliseconds(1), [&]()
+   {
+      for (int i = 0; i < 100; ++i) wheel.schedule(milliseconds(i + 1), [&]() { });
+      if (3 == ++count) BOOST_CHECK(wheel.cancel(self));
+   });
+   wheel.advance(milliseconds(10));
+   BOOST_CHECK_EQUAL(3, count);
+   BOOST_CHECK(!wheel.scheduled(self));
+
+   wheel.advance(milliseconds(200));
+   BOOST_CHECK_EQUAL(0, wheel.size());
+}
+
+BOOST_AUTO_TEST_CASE( throwingCallback )
+{
+   TimerWheel wheel;
+   std::vector<int> fired;
+
+   wheel.schedule(milliseconds(1), [&]() { fired.push_back(1); throw std::runtime_error("test"); });
+   wheel.schedule(milliseconds(1), [&]() { fired.push_back(2); });
+   BOOST_CHECK_THROW(wheel.advance(milliseconds(1)), std::runtime_error);
+   BOOST_CHECK(fired == std::vector<int>({ 1 }));
+
+   // the rest of the tick's timers fire next time
+   BOOST_CHECK_EQUAL(1, wheel.advance(milliseconds(0)));
+   BOOST_CHECK(fired == std::vector<int>({ 1, 2 }));
+}
+
+BOOST_AUTO_TEST_CASE( longDelays )
+{
+   // delays across every level of the wheel, and beyond the top one, fire on
+   // exactly their tick however time is advanced
+   TimerWheel wheel;
+   std::mt19937 random(42);
+
+   std::vector<std::uint64_t> delays = { 63, 64, 65, 4095, 4096, 4097, 262144, 16777217, std::uint64_t(1) << 37 };
+   for (int i = 0; i < 200; ++i) delays.push_back(std::uniform_int_distribution<std::uint64_t>(1, 100000000)(random));
+
+   std::vector<std::uint64_t> firedAt(delays.size(), 0);
+   std::uint64_t now = 0;
+   for (std::size_t i = 0; i < delays.size(); ++i)
+   {
+      wheel.schedule(milliseconds(delays[i]), [&, i]() { firedAt[i] = now; });
+   }
+
+   while (wheel.size() > 0)
+   {
+      auto step = std::uniform_int_distribution<std::uint64_t>(1, now < 200000000 ? 5000000 : std::uint64_t(1) << 33)(random);
+      for (std::size_t i = 0; i < delays.size(); ++i)
+      {
+         // step exactly onto the next due timer, so firedAt is exact
+         if (0 == firedAt[i] && delays[i] > now && delays[i] - now < step) step = delays[i] - now;
+      }
+      now += step;
+      wheel.advance(milliseconds(step));
+   }
+
+   for (std::size_t i = 0; i < delays.size(); ++i) BOOST_CHECK_EQUAL(delays[i], firedAt[i]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()